@@ -9,16 +9,181 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
-
-using std::fstream;
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <new>
+#if defined( __GNUC__ ) && ( defined( __i386__ ) || defined( __x86_64__ ) )
+#include <immintrin.h>
+#define COLLIDE_X86
+#define TARGET_SSE2 __attribute__(( target( "sse2" ) ))
+#define TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#elif defined( _MSC_VER ) && ( defined( _M_IX86 ) || defined( _M_X64 ) )
+#include <immintrin.h>
+#define COLLIDE_X86
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 //Screen dimension constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
-#define NUM_OF_OBSTACLES 2
 #define NUM_OF_MENU 3
 
+//Frame rate cap of the screens that only redraw on demand, how often they wake
+//while the asset loader is busy and the longest they sleep otherwise
+const int SCENE_FRAME_RATE = 30;
+const Uint32 LOADER_PUMP_MS = 1000 / 30;
+const Uint32 IDLE_WAIT_MS = 1000;
+
+//How long the last frame of a game stays up before the score
+const Uint32 GAME_OVER_HOLD_MS = 2000;
+
+//Obstacle generator defaults: ring capacity (--obstacles), gap between
+//shelves (--spacing) and chance in percent of lights over a shelf (--density)
+const int DEFAULT_NUM_OF_OBSTACLES = 8;
+const int MAX_NUM_OF_OBSTACLES = 4096;
+const int DEFAULT_OBSTACLE_SPACING = 200;
+const int MAX_OBSTACLE_SPACING = 10000;
+const int DEFAULT_OBSTACLE_DENSITY = 100;
+
+//Boxes generated per entity kind, set with --hitboxes
+const int DEFAULT_NUM_OF_HITBOXES = 4;
+const int MAX_NUM_OF_HITBOXES = 16;
+
+//Frame rate the movement constants were tuned at
+const float REFERENCE_FPS = 60.0f;
+
+//Simulation tick rate bounds and defaults
+const int MIN_TICK_RATE = 30;
+const int MAX_TICK_RATE = 1000;
+const int DEFAULT_TICK_RATE = 120;
+const int DEFAULT_MAX_CATCH_UP_MS = 250;
+
+//Highest game frame rate --frame-cap takes, and the limiter's when the display reports none
+const int MAX_FRAME_CAP = 1000;
+const int DEFAULT_FRAME_CAP = 60;
+
+//Sleeps overshoot by up to a couple of milliseconds, the limiter spins through the last of each frame
+const Uint32 SPIN_MARGIN_MS = 2;
+
+//Press times of the latest flaps a snapshot carries for --latency, more landing
+//between two presented frames go uncounted
+const Uint32 FLAP_TIME_SLOTS = 16;
+
+//How game frames are paced: waiting for the refresh in the present, the same but tearing
+//frames that miss it, as fast as they render, or by a timer at --frame-cap
+enum PacingMode
+{
+	PACING_VSYNC,
+	PACING_ADAPTIVE,
+	PACING_UNCAPPED,
+	PACING_LIMITER,
+	NUM_OF_PACING_MODES
+};
+
+//Ticks each headless benchmark thread simulates by default
+const Uint32 DEFAULT_BENCH_TICKS = 1000000;
+
+//Player inputs the simulation understands
+enum InputAction
+{
+	INPUT_FLAP_PRESS,
+	INPUT_FLAP_RELEASE
+};
+
+//Input applied at a given simulation tick
+struct ScriptedInput
+{
+	Uint32 tick;
+	InputAction action;
+};
+
+//Input from the keyboard, at the performance counter value it happened at
+struct TimedInput
+{
+	Uint64 time;
+	InputAction action;
+};
+
+//How the obstacle generator lays out a game
+struct ObstacleSettings
+{
+	//Shelves, and lights, that can be alive at once
+	int capacity;
+
+	//Average gap between shelves, in pixels
+	int spacing;
+
+	//Chance in percent of a shelf getting lights over it
+	int density;
+};
+
+//How the roach is checked against obstacles
+struct CollisionSettings
+{
+	//Boxes generated from each sprite
+	int hitboxes;
+
+	//Stop at the boxes instead of going on to the pixel masks
+	bool boxesOnly;
+};
+
+//A recorded game: layout seed and settings, tick rate, every input and the outcome
+struct Recording
+{
+	Uint32 seed;
+	int tickRate;
+	ObstacleSettings obstacles;
+	CollisionSettings collision;
+	std::vector<ScriptedInput> inputs;
+
+	//Where the game ended, to check replays against
+	Uint32 finalTick;
+	Uint32 finalScore;
+};
+
+//Small deterministic random generator, one per simulated world
+class Random
+{
+	public:
+		//Seeds the generator
+		Random( Uint32 seed = 1 );
+		void seed( Uint32 seed );
+
+		//Gets the next pseudo-random number
+		Uint32 next();
+
+		//Gets a pseudo-random number in [0, n)
+		int range( int n );
+
+	private:
+		Uint32 mState;
+};
+
+//Renderer work done through LTexture
+struct RenderStats
+{
+	Uint32 drawCalls;
+	Uint32 textureCreations;
+	Uint32 textureDestructions;
+	Uint64 bytesUploaded;
+};
+
 //Texture wrapper class
 class LTexture
 {
@@ -29,11 +194,21 @@ class LTexture
 		//Deallocates memory
 		~LTexture();
 
-		//Loads image at specified path
-		bool loadFromFile( std::string path );
+		//Creates texture from surface pixels
+		bool loadFromSurface( SDL_Surface* surface );
+
+		//Creates a transparent texture to be filled in with update()
+		bool createBlank( int width, int height );
+
+		//Creates a transparent texture to be drawn into after setAsRenderTarget()
+		bool createTarget( int width, int height );
+
+		//Sends rendering to the texture, or back to the window
+		bool setAsRenderTarget();
+		static void resetRenderTarget();
 
-		//Creates image from font string
-        bool loadFromRenderedText( std::string textureText, SDL_Color textColor );
+		//Uploads ARGB8888 pixels into part of the texture
+		bool update( const SDL_Rect& rect, const void* pixels, int pitch );
 
 		//Deallocates texture
 		void free();
@@ -41,1277 +216,6691 @@ class LTexture
 		//Renders texture at given point
 		void render( int x, int y, SDL_Rect* clip = NULL, double angle = 0.0, SDL_Point* center = NULL, SDL_RendererFlip flip = SDL_FLIP_NONE );
 
+		//Renders a batch of textured triangles in one draw call
+		void renderGeometry( const SDL_Vertex* vertices, int numVertices, const int* indices, int numIndices );
+
 		//Gets image dimensions
 		int getWidth();
 		int getHeight();
 
-		//Gets image coordinates
-		int getX();
-		int getY();
+		//Closes the frame's renderer statistics, call after each present
+		static void endStatsFrame();
+
+		//Gets statistics of the last finished frame and of the whole run
+		static const RenderStats& getFrameStats();
+		static const RenderStats& getTotalStats();
 
-		//Sets image coordinates
-		void setX(int xPos);
-		void setY(int yPos);
+		//Gets memory held by live textures
+		static Uint64 getLiveTextureBytes();
 
 	private:
+		//Counts a new texture and its upload
+		void countCreation();
+
 		//The actual hardware texture
 		SDL_Texture* mTexture;
 
 		//Image dimensions
 		int mWidth;
 		int mHeight;
-		int x;
-		int y;
+
+		//Texture memory size
+		Uint64 mBytes;
+
+		//Counters for the frame being drawn, the last finished one and the run
+		static RenderStats sCurrentStats;
+		static RenderStats sFrameStats;
+		static RenderStats sTotalStats;
+		static Uint64 sLiveBytes;
+
+		//Frames and time since the last --render-stats log line
+		static Uint32 sLogFrames;
+		static RenderStats sLogStats;
+		static Uint64 sLogStart;
 };
 
-class Roach
+//Sprites packed into the sprite atlas
+enum SpriteId
 {
-    public:
-		//The dimensions of the roach
-		static const int ROACH_WIDTH = 92;
-		static const int ROACH_HEIGHT = 59;
+	SPRITE_ROACH,
+	SPRITE_BACKGROUND,
+	SPRITE_SHELF,
+	SPRITE_LIGHTS,
+	SPRITE_COCKY,
+	NUM_OF_SPRITES
+};
 
-		//Maximum axis velocity of the roach
-		static const int ROACH_VEL = 10;
+//All game images in one texture, drawn as one batch of quads per flush
+class LSpriteAtlas
+{
+	public:
+		//Atlas size tried before falling back to the renderer's limit,
+		//fits every sprite whatever order they finish decoding in
+		static const int MAX_ATLAS_SIZE = 1024;
 
-		static const float GRAVITY = 10.0f;
+		//Transparent gap around each sprite so filtering never bleeds
+		static const int PADDING = 2;
 
-		//Initializes the variables
-		Roach();
+		//Initializes variables
+		LSpriteAtlas();
 
-		//Takes key presses and adjusts the roach's position
-		void handleEvent( SDL_Event& e );
+		//Creates the empty atlas texture
+		bool create();
 
-		//Moves the roach and checks collision
-		void move(std::vector<SDL_Rect> &shelf, std::vector<SDL_Rect> &lights);
+		//Shelf-packs one ARGB8888 sprite into the atlas as it arrives
+		bool add( SpriteId sprite, SDL_Surface* surface );
 
-		//Shows the roach on the screen
-		void render();
+		//Checks whether a sprite has been uploaded yet
+		bool isLoaded( SpriteId sprite );
 
-		void gravitate();
+		//Deallocates atlas
+		void free();
 
-		//Gets the collision boxes
-        std::vector<SDL_Rect>& getColliders();
+		//Queues a sprite at given point, flips are done through the texture coordinates
+		void draw( SpriteId sprite, int x, int y, SDL_RendererFlip flip = SDL_FLIP_NONE );
 
-    private:
-		//The X and Y offsets of the roach
-		int mPosX, mPosY;
+		//Renders every queued sprite in one draw call
+		void flush();
 
-		//The velocity of the roach
-		int mVelX, mVelY;
+		//Gets sprite dimensions
+		int getWidth( SpriteId sprite );
+		int getHeight( SpriteId sprite );
+
+	private:
+		//The packed texture
+		LTexture mTexture;
 
-		float mRVel;
+		//Atlas position of each sprite, empty until it is added
+		SDL_Rect mClips[ NUM_OF_SPRITES ];
 
-		//roach's collision boxes
-        std::vector<SDL_Rect> mColliders;
+		//Where the next sprite goes
+		int mPenX;
+		int mPenY;
+		int mRowHeight;
 
-        //Moves the collision boxes relative to the roach's offset
-        void shiftColliders();
+		//Queued quads, reused every frame
+		std::vector<SDL_Vertex> mVertices;
+		std::vector<int> mIndices;
 };
 
-class Shelf
+//A background sprite tiled across the screen and scrolled with the world
+struct ParallaxLayer
 {
-    public:
-		//The dimensions of the shelf
-		static const int SHELF_WIDTH = 141;
-		static const int SHELF_HEIGHT = 480;
+	SpriteId sprite;
 
-		static const float SHELF_SPEED = 1.0f;
+	//Pixels scrolled per pixel the world scrolls, 0 for a layer that stands still
+	float rate;
 
-		//The X and Y offsets of the shelf
-		int mPosX, mPosY;
+	//Top of the layer on screen
+	int y;
 
-		Shelf();
+	//Whether the sprite has no transparent pixels
+	bool opaque;
+};
 
-		//Moves the roach and checks collision
-		void move(std::vector<SDL_Rect> &roach);
+//Back to front. Neighbouring layers with the same rate and sprite width share one cached texture
+const ParallaxLayer PARALLAX_LAYERS[] =
+{
+	{ SPRITE_BACKGROUND, 1.0f, 0, true }
+};
+const int NUM_OF_PARALLAX_LAYERS = sizeof( PARALLAX_LAYERS ) / sizeof( PARALLAX_LAYERS[ 0 ] );
 
-		//Shows the shelf on the screen
-		void render(bool isUpward = true);
+//Background layers composed into render targets once, so a frame copies one screen per
+//group of layers however many sprites went into it. Redrawn only when the targets are lost
+class LParallaxLayers
+{
+	public:
+		//Initializes variables
+		LParallaxLayers();
 
-		void accelerate();
+		//Groups the layers and creates their textures, false until every layer sprite is in the atlas
+		bool create();
 
-		void randomise();
+		//Checks whether the textures are ready
+		bool isCreated();
 
-		//Gets the collision boxes
-        std::vector<SDL_Rect>& getColliders();
+		//Redraws the textures before their next use, after the renderer dropped their contents
+		void invalidate();
 
-        //Moves the collision boxes relative to the shelf's offset
-        void shiftColliders();
+		//Checks whether the layers cover the screen, so the frame needs no clear
+		bool isOpaque();
 
-    private:
-		//The velocity of the shelf
-		int mVelX, mVelY;
+		//Draws the layers for the given world scroll distance
+		void render( double scrolled );
 
-		float mRVel;
+		//Deallocates textures
+		void free();
 
-		//shelf's collision boxes
-        std::vector<SDL_Rect> mColliders;
-};
+	private:
+		//Draws every group's layers into its texture
+		void redraw();
 
-class Lights
-{
-    public:
-		//The dimensions of the lights
-		static const int LIGHTS_WIDTH = 103;
-		static const int LIGHTS_HEIGHT = 480;
+		//Queues a layer's sprite in the atlas, tiled over [0, width) and shifted left by offset
+		void drawTiled( const ParallaxLayer& layer, int width, int offset );
 
-		static const float LIGHTS_SPEED = 1.0f;
+		//Where a layer's tiles start for the given world scroll distance
+		int getOffset( const ParallaxLayer& layer, int period, double scrolled );
 
-		//The X and Y offsets of the lights
-		int mPosX, mPosY;
+		//One texture per group, each a scroll period wider than the screen so a frame is a single copy
+		LTexture mTextures[ NUM_OF_PARALLAX_LAYERS ];
 
-		Lights();
+		//First layer of each group, with one past the last at the end, and how far each group scrolls before it repeats
+		int mGroupStarts[ NUM_OF_PARALLAX_LAYERS + 1 ];
+		int mPeriods[ NUM_OF_PARALLAX_LAYERS ];
+		int mNumOfGroups;
 
-		void move(int shelf_x_position, int shelf_y_position, std::vector<SDL_Rect> &roach);
+		bool mCreated;
+		bool mOpaque;
+		bool mDirty;
 
-		//Shows the lights on the screen
-		void render(bool isUpward = true);
+		//Falls back to drawing the layers straight from the atlas
+		bool mUseTargets;
+};
 
-		void accelerate();
+//Read-only memory mapping of the pre-decoded asset archive written by --pack
+class LAssetPack
+{
+	public:
+		//Initializes variables
+		LAssetPack();
 
-		void randomise(int shelf_y_position);
+		//Maps the archive at given path and checks its table of contents
+		bool open( std::string path );
 
-		//Gets the collision boxes
-        std::vector<SDL_Rect>& getColliders();
+		//Unmaps the archive, fonts opened from it must be closed first
+		void close();
 
-        //Moves the collision boxes relative to the shelf's offset
-        void shiftColliders();
+		//Checks whether an archive is mapped
+		bool isOpen();
 
-    private:
-		//The velocity of the lights
-		int mVelX, mVelY;
+		//Wraps a sprite's pixels in a surface without copying them
+		SDL_Surface* createSurface( SpriteId sprite );
 
-		float mRVel;
+		//Opens the packed font straight from the mapping
+		TTF_Font* openFont( int ptsize );
 
-		//shelf's collision boxes
-        std::vector<SDL_Rect> mColliders;
+	private:
+		//The mapped file
+		const Uint8* mData;
+		size_t mSize;
+#ifdef _WIN32
+		HANDLE mFile;
+		HANDLE mMapping;
+#endif
+
+		//Table of contents
+		Uint32 mSpriteOffsets[ NUM_OF_SPRITES ];
+		int mSpriteWidths[ NUM_OF_SPRITES ];
+		int mSpriteHeights[ NUM_OF_SPRITES ];
+		Uint32 mFontOffset;
+		Uint32 mFontSize;
 };
 
-//Starts up SDL and creates window
-bool init();
+//Decodes sprites on a worker pool and hands them to the main thread for upload
+class LAssetLoader
+{
+	public:
+		//Initializes variables
+		LAssetLoader();
 
-//Loads media
-bool loadMedia();
+		//Starts decoding every sprite, from the mapped archive when it is open
+		bool start();
 
-//Frees media and shuts down SDL
-void close();
+		//Uploads whatever has finished decoding, main thread only
+		void pump();
 
-void randomise_shelf(Shelf shelf[]);
+		//Pumps until the given sprite is in the atlas or loading failed
+		bool waitFor( SpriteId sprite );
 
-void randomise_lights(Lights lights[]);
+		//Gets number of sprites in the atlas
+		int getLoadedCount();
 
-//Box set collision detector
-bool checkCollision(std::vector<SDL_Rect> &roach, std::vector<SDL_Rect> &obstacle);//std::vector<SDL_Rect> &shelf, std::vector<SDL_Rect> &lights);
+		//Checks whether every sprite is in the atlas
+		bool isDone();
 
-//Menu
-void showMenu();
+		//Checks whether a sprite could not be loaded
+		bool hasFailed();
 
-//Core Game
-void startGame();
+		//Waits for the workers and frees anything not uploaded
+		void stop();
 
-//View Score
-int showScore(bool isHighScore = false);
+	private:
+		//Worker thread body
+		static int decode( void* data );
 
-//Evaluate Score
-void evaluateScore();
+		//Sprites in the order they are handed out, the menu needs the logo first
+		static const SpriteId LOAD_ORDER[ NUM_OF_SPRITES ];
 
-//Calculate Score
-void calculateScore();
+		//Worker pool
+		std::vector<SDL_Thread*> mThreads;
 
-//The window we'll be rendering to
-SDL_Window* gWindow = NULL;
+		//Next entry of LOAD_ORDER to hand out
+		SDL_atomic_t mNextJob;
 
-//The window renderer
-SDL_Renderer* gRenderer = NULL;
+		//Decoded surfaces, published through mDecoded
+		SDL_Surface* mSurfaces[ NUM_OF_SPRITES ];
+		SDL_atomic_t mDecoded[ NUM_OF_SPRITES ];
 
-//Globally used font
-TTF_Font *gFont = NULL;
+		//Posted once per decoded sprite so waiting never spins
+		SDL_sem* mDecodedSignal;
 
-//Scene textures
-LTexture gRoachTexture;
-LTexture gBGTexture;
-LTexture gShelfTexture;
-LTexture gLightsTexture;
-LTexture gScoreTexture;
-LTexture gMenuTexture[3];
-LTexture gGenericTexture;
-LTexture gCockyTexture;
+		//Main thread side bookkeeping
+		bool mUploaded[ NUM_OF_SPRITES ];
+		int mLoadedCount;
+		bool mFailed;
+};
 
+//Runs per score in a Fenwick tree, so ranks take logarithmic time however many runs there are
+class ScoreIndex
+{
+    public:
+		ScoreIndex();
 
-Uint32 currentScore;
-Uint32 startTime;
+		//Adds runs with the given score
+		void add(Uint32 score, Uint32 count);
 
-bool endGame;
+		//Gets number of runs and the best score
+		Uint32 getTotal();
+		Uint32 getBest();
 
-LTexture::LTexture()
-{
-	//Initialize
-	mTexture = NULL;
-	mWidth = 0;
-	mHeight = 0;
-}
+		//Gets number of runs that scored less, or more, than the score
+		Uint32 countBelow(Uint32 score);
+		Uint32 countAbove(Uint32 score);
 
-LTexture::~LTexture()
-{
-	//Deallocate
-	free();
-}
+		//Gets every score run at least once, in order, with its number of runs
+		void getHistogram(std::vector<Uint32>& scores, std::vector<Uint32>& counts);
+
+    private:
+		//Makes room for scores up to the given one
+		void grow(Uint32 score);
+
+		//Runs per score and the tree over them, one-based
+		std::vector<Uint32> mCounts;
+		std::vector<Uint32> mTree;
+
+		Uint32 mTotal;
+		Uint32 mBest;
+};
 
-bool LTexture::loadFromFile( std::string path )
+//Keeps every run's score in memory and saves them on a background thread, as an
+//append-only log that is compacted into a snapshot of runs per score now and then
+class LScoreHistory
 {
-	//Get rid of preexisting texture
-	free();
+	public:
+		//Initializes variables
+		LScoreHistory();
 
-	//The final texture
-	SDL_Texture* newTexture = NULL;
+		//Reads the snapshot and log, carrying over an old single high score file, and starts the writer
+		void load( std::string historyPath, std::string logPath, std::string legacyPath );
 
-	//Load image at specified path
-	SDL_Surface* loadedSurface = IMG_Load( path.c_str() );
-	if( loadedSurface == NULL )
-	{
-		printf( "Unable to load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError() );
-	}
-	else
-	{
-		//Color key image
-		SDL_SetColorKey( loadedSurface, SDL_TRUE, SDL_MapRGB( loadedSurface->format, 0, 0xFF, 0xFF ) );
+		//Gets the best score so far
+		Uint32 getBest();
 
-		//Create texture from surface pixels
-        newTexture = SDL_CreateTextureFromSurface( gRenderer, loadedSurface );
-		if( newTexture == NULL )
-		{
-			printf( "Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError() );
-		}
-		else
-		{
-			//Get image dimensions
-			mWidth = loadedSurface->w;
-			mHeight = loadedSurface->h;
-		}
+		//Gets number of runs recorded
+		Uint32 getCount();
 
-		//Get rid of old loaded surface
-		SDL_FreeSurface( loadedSurface );
-	}
+		//Gets a score's rank, 1 for the best, tied scores share a rank
+		Uint32 getRank( Uint32 score );
 
-	//Return success
-	mTexture = newTexture;
-	return mTexture != NULL;
-}
+		//Gets the percentage of runs that scored less
+		double getPercentile( Uint32 score );
 
-bool LTexture::loadFromRenderedText( std::string textureText, SDL_Color textColor )
-{
-    //Get rid of preexisting texture
-    free();
+		//Records a finished game's score, true if it is a new best
+		bool submit( Uint32 score );
 
-    //Render text surface
-    SDL_Surface* textSurface = TTF_RenderText_Solid( gFont, textureText.c_str(), textColor );
-    if( textSurface == NULL )
-    {
-        printf( "Unable to render text surface! SDL_ttf Error: %s\n", TTF_GetError() );
-    }
-    else
-    {
-        //Create texture from surface pixels
-        mTexture = SDL_CreateTextureFromSurface( gRenderer, textSurface );
-        if( mTexture == NULL )
-        {
-            printf( "Unable to create texture from rendered text! SDL Error: %s\n", SDL_GetError() );
-        }
-        else
-        {
-            //Get image dimensions
-            mWidth = textSurface->w;
-            mHeight = textSurface->h;
-        }
+		//Waits for the last save to finish
+		void stop();
 
-        //Get rid of old surface
-        SDL_FreeSurface( textSurface );
-    }
+	private:
+		//Writer thread body
+		static int write( void* data );
 
-    //Return success
-    return mTexture != NULL;
-}
+		//Appends the submitted scores, compacting when the log has grown, writer side
+		void flush();
 
-void LTexture::free()
-{
-	//Free texture if it exists
-	if( mTexture != NULL )
-	{
-		SDL_DestroyTexture( mTexture );
-		mTexture = NULL;
-		mWidth = 0;
-		mHeight = 0;
-	}
-}
+		//Starts a log for the current snapshot if there is none, then appends
+		bool append( const std::vector<Uint32>& scores );
 
-void LTexture::render( int x, int y, SDL_Rect* clip, double angle, SDL_Point* center, SDL_RendererFlip flip )
-{
-	//Set rendering space and render to screen
-	SDL_Rect renderQuad = { x, y, mWidth, mHeight };
+		//Writes a new snapshot of every run and retires the log
+		bool compact();
 
-	//Set clip rendering dimensions
-	if( clip != NULL )
-	{
-		renderQuad.w = clip->w;
-		renderQuad.h = clip->h;
-	}
+		//Read at load, false if missing or damaged. Without a snapshot the log is taken
+		//whatever its generation, a log of another snapshot is set aside
+		bool readHistory();
+		bool readLog( bool hasHistory );
 
-	//Render to screen
-	SDL_RenderCopyEx( gRenderer, mTexture, clip, &renderQuad, angle, center, flip );
-}
+		std::string mHistoryPath;
+		std::string mLogPath;
 
-int LTexture::getWidth()
-{
-	return mWidth;
-}
+		//Main thread index
+		ScoreIndex mIndex;
 
-int LTexture::getHeight()
-{
-	return mHeight;
-}
+		//Writer side index of what is on disk, snapshot generation and log state
+		ScoreIndex mSaved;
+		Uint32 mGeneration;
+		bool mLogValid;
+		Uint32 mLogCount;
+		bool mNeedsCompaction;
 
-int LTexture::getX()
-{
-	return x;
-}
+		//Scores submitted but not yet handed to the writer
+		std::vector<Uint32> mPending;
+		std::vector<Uint32> mWriting;
+		SDL_mutex* mPendingLock;
 
-int LTexture::getY()
-{
-	return y;
-}
+		//Whether the writer should exit
+		SDL_atomic_t mQuit;
 
-void LTexture::setX(int xPos)
-{
-    x = xPos;
-}
+		//Posted whenever there is something for the writer to do
+		SDL_sem* mWriteSignal;
+		SDL_Thread* mThread;
+};
 
-void LTexture::setY(int yPos)
+//Glyph atlas text renderer
+class LTextAtlas
 {
-    y = yPos;
-}
+	public:
+		//Printable character range kept in the atlas
+		static const int FIRST_GLYPH = 32;
+		static const int LAST_GLYPH = 126;
+		static const int NUM_OF_GLYPHS = LAST_GLYPH - FIRST_GLYPH + 1;
 
-Roach::Roach()
-{
-    //Initialize the offsets
-    mPosX = (SCREEN_WIDTH / 2) - (ROACH_WIDTH / 2);
-    mPosY = SCREEN_HEIGHT / 2 - (ROACH_HEIGHT / 2);
+		//Width of the atlas texture
+		static const int ATLAS_WIDTH = 512;
+
+		//Glyphs submitted per draw call
+		static const int MAX_BATCH_GLYPHS = 64;
 
-    //Initialize the velocity
-    mVelX = 0;
-    mVelY = 0;
+		//Initializes variables
+		LTextAtlas();
 
-    mRVel = 0.0f;
+		//Rasterizes every printable glyph of the font into one texture
+		bool loadFromFont( TTF_Font* font );
 
-    mColliders.resize(2);
+		//Deallocates atlas
+		void free();
 
-    //Initialize the collision boxes' width and height
-    mColliders[ 0 ].w = 66;
-    mColliders[ 0 ].h = 33;
+		//Renders string at given point as batched glyph quads
+		void render( int x, int y, const char* text, SDL_Color textColor, float scale = 1.0f );
 
-    mColliders[ 1 ].w = 91;
-    mColliders[ 1 ].h = 17;
+		//Gets rendered string dimensions
+		int getTextWidth( const char* text );
+		int getHeight();
 
-    //Initialize colliders' relative to position
-    shiftColliders();
-}
+	private:
+		//Maps a character to its glyph slot
+		int glyphIndex( char c );
 
-void Roach::handleEvent( SDL_Event& e )
-{
-    //If a key was pressed
-	if( e.type == SDL_KEYDOWN && e.key.repeat == 0 && mRVel >= GRAVITY / 8.0f)
-    {
-        //Adjust the velocity
-        switch( e.key.keysym.sym )
-        {
-            case SDLK_SPACE:
-                mRVel = -GRAVITY / 2.2f;
-            break;
-        }
-    }
-    //If a key was released
-    else if( e.type == SDL_KEYUP && e.key.repeat == 0 )
-    {
-        //Adjust the velocity
-        switch( e.key.keysym.sym )
-        {
-            case SDLK_SPACE:
-                mRVel += GRAVITY / 8.0f;
-            break;
-        }
-    }
-}
+		//White glyphs, tinted through vertex colors
+		LTexture mTexture;
 
-void Roach::move(std::vector<SDL_Rect> &shelf, std::vector<SDL_Rect> &lights)
-{
-    if (mVelY >= GRAVITY)
-    {
-        mVelY = GRAVITY;
-    }
+		//Atlas position and pen advance of each glyph
+		SDL_Rect mGlyphClips[ NUM_OF_GLYPHS ];
+		int mGlyphAdvances[ NUM_OF_GLYPHS ];
 
-    mPosY += mVelY;
-    shiftColliders();
+		//Font line height
+		int mHeight;
 
-    //If the roach went too far up or down or collides to shelf or lights
-    if(( mPosY < 0 ) || ( mPosY + ROACH_HEIGHT > SCREEN_HEIGHT ))
-    {
-        //Move back
-        mPosY -= mVelY;
-        shiftColliders();
-        endGame = true;
-    }
-}
+		//Preallocated quad batch
+		SDL_Vertex mVertices[ MAX_BATCH_GLYPHS * 4 ];
+		int mIndices[ MAX_BATCH_GLYPHS * 6 ];
+};
 
-void Roach::gravitate()
+//Game loop phases the profiler times
+enum ProfilePhase
 {
-    mRVel += 0.008f;
-
-    mVelY = (int)mRVel;
-}
+	PHASE_EVENTS,
+	PHASE_PHYSICS,
+	PHASE_COLLISION,
+	PHASE_SCORE,
+	PHASE_BACKGROUND,
+	PHASE_SPRITES,
+	PHASE_HUD,
+	PHASE_PRESENT,
+	NUM_OF_PHASES
+};
 
-void Roach::shiftColliders()
+//Per-phase frame timings with rolling averages and an overlay
+class Profiler
 {
-    mColliders[0].x = mPosX + 28; //magic #
-    mColliders[0].y = mPosY + 5; //magic #
+	public:
+		//Frames kept for averages and the graph
+		static const int HISTORY = 120;
 
-    mColliders[1].x = mPosX + 2; //magic #
-    mColliders[1].y = mPosY + mColliders[0].h;
-}
+		//Initializes variables
+		Profiler();
 
-std::vector<SDL_Rect>& Roach::getColliders()
-{
-	return mColliders;
-}
+		//Starts or stops timing, clearing old samples
+		void setEnabled( bool enabled );
+		bool isEnabled();
 
-void Roach::render()
-{
-    //Show the roach
-	gRoachTexture.render( mPosX, mPosY );
-}
+		//Adds performance counter time to a phase of the current frame
+		void add( ProfilePhase phase, Uint64 elapsed );
 
-Shelf::Shelf()
-{
-    //Initialize the offsets
-    mPosX = (SCREEN_WIDTH) - (rand() % 20);
-    mPosY = rand() % SCREEN_HEIGHT + ((SCREEN_HEIGHT / 2) + 100);
+		//Closes the current frame
+		void endFrame( Uint64 frameTime );
+
+		//Gets rolling averages in milliseconds
+		double getAverage( ProfilePhase phase );
+		double getFrameAverage();
 
-    //Initialize the velocity
-    mVelX = 0;
-    mVelY = 0;
+		//Shows averages and a frame-time graph
+		void render();
 
-    mRVel = 0.0f;
+	private:
+		bool mEnabled;
 
-    mColliders.resize(1);
+		//Time spent in each phase this frame
+		Uint64 mCurrent[ NUM_OF_PHASES ];
 
-    //Initialize the collision boxes' width and height
-    mColliders[ 0 ].w = 141;
-    mColliders[ 0 ].h = 480;
+		//Ring of past frames, in milliseconds, and running sums over it
+		float mHistory[ HISTORY ][ NUM_OF_PHASES ];
+		float mFrameHistory[ HISTORY ];
+		double mSums[ NUM_OF_PHASES ];
+		double mFrameSum;
+		int mNext;
+		int mCount;
 
-    //Initialize colliders relative to position
-    shiftColliders();
-}
+		//Preallocated graph bars
+		SDL_Rect mBars[ HISTORY ];
+};
 
-void Shelf::accelerate()
+//Adds the time until the end of its scope to a profiler phase
+class ScopedTimer
 {
-    mRVel += 0.008f;
+	public:
+		//Times into the profiler, or into per-phase totals kept by a thread of its own
+		ScopedTimer( ProfilePhase phase, Uint64* totals = NULL );
+		~ScopedTimer();
 
-    mVelX = (int)mRVel;
-}
+	private:
+		ProfilePhase mPhase;
+		Uint64* mTotals;
+		Uint64 mStart;
+};
 
-void Shelf::shiftColliders()
+//One begin or end mark for the trace viewer
+struct TraceEvent
 {
-    //Row offset
-    int r = 0;
+	//Always a string literal, only the pointer is kept
+	const char* name;
 
-    //Go through the shelf's collision boxes
-    for( int set = 0; set < mColliders.size(); ++set )
-    {
-        mColliders[set].x = mPosX + (SHELF_WIDTH - mColliders[set].w);
-        mColliders[set].y = mPosY + r;
-        r += mColliders[set].h;
-    }
-}
+	//'B'egin or 'E'nd
+	char phase;
 
-std::vector<SDL_Rect>& Shelf::getColliders()
-{
-	return mColliders;
-}
+	unsigned long thread;
+	Uint64 timestamp;
+};
 
-void Shelf::move(std::vector<SDL_Rect> &roach)//, std::vector<SDL_Rect> &lights)
+//Preallocated lock-free event buffer, written out as Chrome trace JSON
+class TraceBuffer
 {
-    if (mVelX >= SHELF_SPEED)
-    {
-        mVelX = SHELF_SPEED;
-    }
+	public:
+		//Events kept per session
+		static const int DEFAULT_CAPACITY = 1 << 20;
 
-    mPosX -= mVelX;
-    shiftColliders();
+		//Initializes variables
+		TraceBuffer();
 
-    if (mPosX + SHELF_WIDTH < 0)
-    {
-        mPosX = SCREEN_WIDTH;
-        randomise();
-        shiftColliders();
-    }
+		//Deallocates memory
+		~TraceBuffer();
 
-    //If the shelf collides to roach
-    if(checkCollision(roach, mColliders))
-    {
-        //Move back
-        mPosX += mVelX;
-        shiftColliders();
-        endGame = true;
-    }
-}
+		//Allocates the buffer and starts recording
+		bool start( int capacity = DEFAULT_CAPACITY );
+		bool isActive();
 
-void Shelf::render(bool isUpward)
-{
-    //Show the roach
-	gShelfTexture.render( mPosX, mPosY );
-}
+		//Records a mark from any thread without locking
+		void begin( const char* name );
+		void end( const char* name );
 
-void Shelf::randomise()
-{
-    int randomHeight;
+		//Writes recorded events once every recording thread has stopped
+		bool write( std::string path );
 
-    randomHeight = 50 + rand() % (SCREEN_HEIGHT + 1) - 50;
+	private:
+		void record( const char* name, char phase );
 
-    if (randomHeight < (SCREEN_HEIGHT / 3))
-    {
-        randomHeight += 100;
-    }
-    mPosY = randomHeight;
-}
+		TraceEvent* mEvents;
+		int mCapacity;
 
-Lights::Lights()
-{
-    //Initialize the offsets
-    mPosX = (SCREEN_WIDTH) - (rand() % 20);
-    mPosY = 0;
+		//Next free slot and events lost to a full buffer
+		SDL_atomic_t mNext;
+		SDL_atomic_t mDropped;
 
-    //Initialize the velocity
-    mVelX = 0;
-    mVelY = 0;
+		//Counter value at start, trace time zero
+		Uint64 mStart;
+};
 
-    mRVel = 0.0f;
+//Marks the lifetime of its scope in the trace
+class TraceScope
+{
+	public:
+		TraceScope( const char* name );
+		~TraceScope();
 
-    mColliders.resize(3);
+	private:
+		const char* mName;
+};
 
-    //Initialize the collision boxes' width and height
+//Roach tuning, velocities are in pixels per reference frame
+const int ROACH_WIDTH = 92;
+const int ROACH_HEIGHT = 59;
+const float GRAVITY = 10.0f;
 
-    //pole
-    mColliders[ 0 ].w = 11;
-    mColliders[ 0 ].h = 420;
+//Velocity gained per second of falling
+const float FALL_ACCELERATION = 8.0f;
 
-    //lamp
-    mColliders[ 1 ].w = 103;
-    mColliders[ 1 ].h = 45;
+//Obstacle tuning
+const int SHELF_WIDTH = 141;
+const int SHELF_HEIGHT = 480;
+const int LIGHTS_WIDTH = 103;
+const int LIGHTS_HEIGHT = 480;
 
-    //bulb
-    mColliders[ 2 ].w = 20;
-    mColliders[ 2 ].h = 17;
+//How far past the right edge of the screen obstacles are generated
+const int GENERATE_AHEAD = SCREEN_WIDTH;
 
-    //Initialize colliders relative to position
-    shiftColliders();
-}
+//Obstacle scroll speed and the velocity gained per second until it is reached
+const int OBSTACLE_SPEED = 1;
+const float OBSTACLE_ACCELERATION = 8.0f;
 
-void Lights::accelerate()
+//Kinds of entity in the world, each stored in its own component arrays
+enum EntityKind
 {
-    mRVel += 0.008f;
-
-    mVelX = (int)mRVel;
-}
+    ENTITY_ROACH,
+    ENTITY_SHELF,
+    ENTITY_LIGHTS,
+    NUM_OF_ENTITY_KINDS
+};
 
-void Lights::shiftColliders()
+//An entity, by kind and slot in its kind's pool
+struct EntityRef
 {
-    //Manual setting of colliders
-    //pole
-    mColliders[0].x = mPosX + 46; //magic #
-    mColliders[0].y = mPosY;
+    int kind;
+    int index;
+};
 
-    //lamp
-    mColliders[1].x = mPosX;
-    mColliders[1].y = mPosY + mColliders[0].h;
+//What all entities of a kind share
+struct EntityKindInfo
+{
+    //How the kind is drawn
+    SpriteId sprite;
+    SDL_RendererFlip flip;
 
-    //bulb
-    mColliders[2].x = mPosX + 40; //magic #
-    mColliders[2].y = mPosY + mColliders[0].h + mColliders[1].h;
+    //Direction the kind moves in
+    float dirX;
+    float dirY;
 
-}
+    //Velocity gained per second and the velocity cap
+    float acceleration;
+    int maxVel;
+};
 
-std::vector<SDL_Rect>& Lights::getColliders()
+//Component arrays of every entity of one kind, indexed alike. The live
+//entities are a ring of slots from head on, oldest first
+struct EntityPool
 {
-	return mColliders;
-}
+    //Positions, now and before the last simulation step
+    std::vector<float> posX;
+    std::vector<float> posY;
+    std::vector<float> prevX;
+    std::vector<float> prevY;
 
-void Lights::move(int shelf_x_position, int shelf_y_position, std::vector<SDL_Rect> &roach)//, std::vector<SDL_Rect> &shelf)
-{
-    if (mVelX >= LIGHTS_SPEED)
-    {
-        mVelX = LIGHTS_SPEED;
-    }
+    //Velocity along the kind's direction, unrounded and as moved by. Shared by the
+    //whole kind, so a slot coming live moves as fast as the rest of its ring
+    float rVel;
+    int vel;
 
-    mPosX -= mVelX;
-    shiftColliders();
+    //First live slot and number of live slots
+    int head;
+    int count;
 
-    if (mPosX + LIGHTS_WIDTH < 0 && shelf_x_position > SCREEN_WIDTH / 2)
-    {
-        mPosX = shelf_x_position + 20;
-        randomise(shelf_y_position);
-        shiftColliders();
-    }
+    //Sets the number of slots, all at rest at the origin, none live
+    void resize(int capacity);
 
-    //If the lights collides to roach
-    if(checkCollision(roach, mColliders))
-    {
-        //Move back
-        mPosX += mVelX;
-        shiftColliders();
-        endGame = true;
-    }
-}
+    //Gets number of slots, live or not
+    int capacity();
 
-void Lights::render(bool isUpward)
-{
-    //Show the roach
-    if (isUpward)
-    {
-        gLightsTexture.render( mPosX, mPosY );
-    }
-    else
-    {
-        gLightsTexture.render( mPosX, mPosY, NULL, 0.0, NULL, SDL_FLIP_VERTICAL);
-    }
-}
+    //Gets the slot of the k-th live entity, oldest first
+    int slot(int k);
 
-void Lights::randomise(int shelf_y_position)
-{
-    int randomHeight;
+    //Makes the slot after the newest live entity live and returns it, the pool must not be full
+    int push();
 
-    randomHeight = rand() % (LIGHTS_HEIGHT - 100);
+    //Retires the oldest live entity
+    void pop();
+};
 
-    mPosY = randomHeight * (-1);
+//Streams shelves and lights into their rings ahead of the screen, from a seed
+class ObstacleGenerator
+{
+    public:
+		//Starts a new layout
+		void reset(Uint32 seed, const ObstacleSettings &settings);
 
-    int lightsPosition = mPosY + LIGHTS_HEIGHT;
+		//Spawns obstacles until GENERATE_AHEAD is covered or a ring is full
+		void generate(EntityPool &shelves, EntityPool &lights);
 
-    if (lightsPosition >= shelf_y_position - 200)
-    {
-        mPosY = shelf_y_position - LIGHTS_HEIGHT - 100;
-    }
+    private:
+		Random mRng;
+		ObstacleSettings mSettings;
+};
 
-    if (mPosY + LIGHTS_HEIGHT >= SCREEN_HEIGHT - 100)
-    {
-        mPosY -= 150;
-    }
-}
+//Box test over a collider store's boxes from first up to count, returning the first one overlapping
+//or -1. Vector kernels may read on into the padding
+typedef int (*OverlapKernel)( const Sint32* minX, const Sint32* maxX, const Sint32* minY, const Sint32* maxY, int first, int count, const SDL_Rect& box );
 
-bool init()
+//Collision boxes as separate edge arrays, so many boxes can be tested per instruction
+class ColliderStore
 {
-	//Initialization flag
-	bool success = true;
+    public:
+		//Boxes tested at once by the widest kernel, the arrays are padded to a multiple of it
+		static const int LANES = 8;
 
-	//Initialize SDL
-	if( SDL_Init( SDL_INIT_VIDEO ) < 0 )
-	{
-		printf( "SDL could not initialize! SDL Error: %s\n", SDL_GetError() );
-		success = false;
-	}
-	else
-	{
-		//Set texture filtering to linear
-		if( !SDL_SetHint( SDL_HINT_RENDER_SCALE_QUALITY, "1" ) )
-		{
-			printf( "Warning: Linear texture filtering not enabled!" );
-		}
+		ColliderStore();
 
-		//Create window
-		gWindow = SDL_CreateWindow( "Cocky Roach", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN );
-		if( gWindow == NULL )
-		{
-			printf( "Window could not be created! SDL Error: %s\n", SDL_GetError() );
-			success = false;
-		}
-		else
-		{
-			//Create vsynced renderer for window
-			gRenderer = SDL_CreateRenderer( gWindow, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC );
-			if( gRenderer == NULL )
-			{
-				printf( "Renderer could not be created! SDL Error: %s\n", SDL_GetError() );
-				success = false;
-			}
-			else
-			{
-				//Initialize renderer color
-				SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
+		//Empties the store, keeping its memory
+		void clear();
 
-				//Initialize PNG loading
-				int imgFlags = IMG_INIT_PNG;
-				if( !( IMG_Init( imgFlags ) & imgFlags ) )
-				{
-					printf( "SDL_image could not initialize! SDL_image Error: %s\n", IMG_GetError() );
-					success = false;
-				}
+		//Appends a box
+		void add(const SDL_Rect& box);
 
-				//Initialize SDL_ttf
-                if( TTF_Init() == -1 )
-                {
-                    printf( "SDL_ttf could not initialize! SDL_ttf Error: %s\n", TTF_GetError() );
-                    success = false;
-                }
-			}
-		}
-	}
+		//Gets number of boxes
+		int size();
 
-	return success;
-}
+		//Finds the first stored box from first on that overlaps the box, -1 if none does
+		int findOverlap(const SDL_Rect& box, int first);
 
-bool loadMedia()
-{
-	//Loading success flag
-	bool success = true;
+		//Picks the kernel by name ("auto", "avx2", "sse2" or "scalar"), false if the CPU can't run it
+		static bool selectKernel(const char* name);
 
-	//Load roach texture
-	if( !gRoachTexture.loadFromFile( "00_cocky_roach/roach.png" ) )
-	{
-		printf( "Failed to load roach texture!\n" );
-		success = false;
-	}
+		//Gets the name of the kernel in use
+		static const char* getKernelName();
 
-	//Load background texture
-	if( !gBGTexture.loadFromFile( "00_cocky_roach/bg.png" ) )
-	{
-		printf( "Failed to load background texture!\n" );
-		success = false;
-	}
+    private:
+		//Edges of every box, left and top inclusive, right and bottom exclusive
+		std::vector<Sint32> mMinX;
+		std::vector<Sint32> mMaxX;
+		std::vector<Sint32> mMinY;
+		std::vector<Sint32> mMaxY;
+
+		//Boxes in use, the rest of the last LANES block is padding that never overlaps
+		int mCount;
+
+		//Kernel shared by every store
+		static OverlapKernel sKernel;
+		static const char* sKernelName;
+};
 
-	//Load shelf texture
-	if( !gShelfTexture.loadFromFile( "00_cocky_roach/obstacle.png" ) )
-	{
-		printf( "Failed to load shelf texture!\n" );
-		success = false;
-	}
+//One bit per opaque pixel of a sprite, as drawn. Rows are packed into 64-bit
+//words with the leftmost pixel in the top bit
+class CollisionMask
+{
+    public:
+		CollisionMask();
 
-	//Load lights texture
-	if( !gLightsTexture.loadFromFile( "00_cocky_roach/lights.png" ) )
-	{
-		printf( "Failed to load lights texture!\n" );
-		success = false;
-	}
+		//Builds the mask from an ARGB8888 surface, flipped the way the sprite is drawn
+		bool build(SDL_Surface* surface, SDL_RendererFlip flip);
 
-	//Load menu logo texture
-	if( !gCockyTexture.loadFromFile( "00_cocky_roach/cocky_roach.png" ) )
-	{
-		printf( "Failed to load cocky texture!\n" );
-		success = false;
-	}
+		//Gets the smallest box around the opaque pixels, relative to the sprite's corner
+		const SDL_Rect& getBounds() const;
 
-	//Open the font
-    gFont = TTF_OpenFont( "00_cocky_roach/lazy.ttf", 28 );
-    if( gFont == NULL )
-    {
-        printf( "Failed to load lazy font! SDL_ttf Error: %s\n", TTF_GetError() );
-        success = false;
-    }
+		//Checks whether opaque pixels overlap those of another mask placed at (dx, dy) from this one
+		bool overlaps(const CollisionMask& other, int dx, int dy) const;
 
-	return success;
-}
+		//Covers the opaque pixels with at most maxBoxes horizontal bands, each the box around its
+		//rows, leaving the fewest transparent pixels covered. errors[k - 1] gets that count for k boxes
+		void generateHitboxes(int maxBoxes, std::vector<SDL_Rect>& boxes, std::vector<int>& errors) const;
 
-void close()
-{
-	//Free loaded images
-	gRoachTexture.free();
-	gBGTexture.free();
-	gShelfTexture.free();
-	gLightsTexture.free();
-	gScoreTexture.free();
-	gGenericTexture.free();
-	gCockyTexture.free();
+		//Gets number of opaque pixels
+		int getOpaqueCount() const;
 
-	for(int i = 0; i < NUM_OF_MENU; ++i)
-    {
-        gMenuTexture[i].free();
-    }
+    private:
+		//Gets whether the pixel at (x, y) is opaque
+		bool isOpaque(int x, int y) const;
 
-    //Free global font
-    TTF_CloseFont( gFont );
-    gFont = NULL;
+		//Gets the 64 pixels of row y from x on, zero past the right edge
+		Uint64 fetch(int y, int x) const;
 
-	//Destroy window
-	SDL_DestroyRenderer( gRenderer );
-	SDL_DestroyWindow( gWindow );
-	gWindow = NULL;
-	gRenderer = NULL;
+		int mWidth;
+		int mHeight;
+		int mWordsPerRow;
+		std::vector<Uint64> mBits;
+		SDL_Rect mBounds;
+};
 
-	//Quit SDL subsystems
-	TTF_Quit();
-	IMG_Quit();
-	SDL_Quit();
-}
+//An entity on screen, where it is after a tick and where it was one tick before
+struct SpritePosition
+{
+    float prevX, prevY;
+    float x, y;
+};
 
-void randomise_shelf(Shelf shelf[])
+//What the renderer needs of the world after a tick, so it can draw while the next ones are simulated
+struct WorldSnapshot
 {
-    int randomHeight;
+    Uint32 tick;
+    Uint32 score;
+    bool ended;
 
-    srand(time(0));
+    //Background scroll distance after the tick and one tick before
+    double scrolled, prevScrolled;
 
-    for (int i = 0; i < NUM_OF_OBSTACLES; ++i)
-    {
-        int max = SCREEN_HEIGHT - 100;
-        int min = 50 + SCREEN_HEIGHT / 2;
+    //Performance counter value the tick was due at
+    Uint64 tickTime;
 
-        randomHeight = min + rand() % ((max+ 1) - min);
+    //Flaps applied since the game started, and when the player pressed each of the
+    //latest ones, flap n at n % FLAP_TIME_SLOTS
+    Uint32 flaps;
+    Uint64 flapTimes[FLAP_TIME_SLOTS];
 
-        if (i != 0)
-        {
-            shelf[i].mPosX = shelf[i - 1].mPosX + shelf[i].SHELF_WIDTH + 200;
-            shelf[i].shiftColliders();
-        }
+    //Simulation time per profiler phase since the game started
+    Uint64 phaseTimes[NUM_OF_PHASES];
 
-        shelf[i].mPosY = randomHeight;
-        shelf[i].shiftColliders();
-    }
-}
+    //Entities on screen, one list per kind
+    std::vector<SpritePosition> sprites[NUM_OF_ENTITY_KINDS];
+};
 
-void randomise_lights(Lights lights[])
+//Lock-free triple buffer of snapshots. The simulation fills the back one and swaps it into the
+//middle, the renderer swaps its front one for the middle whenever a newer one is waiting.
+//Neither side ever waits on the other, and a snapshot being read is never written
+class SnapshotBuffer
 {
-    int randomHeight;
+	public:
+		//Initializes variables
+		SnapshotBuffer();
 
-    srand(time(0));
+		//Starts over with no snapshot waiting, room for the given number of obstacles
+		//per kind. Neither side may be running
+		void reset( int capacity );
 
-    for (int i = 0; i < NUM_OF_OBSTACLES; ++i)
-    {
-        int max = lights[i].LIGHTS_HEIGHT - 100;
-        int min = (lights[i].LIGHTS_HEIGHT / 2) + 100;
+		//Gets the snapshot the simulation fills next
+		WorldSnapshot& getBack();
 
-        randomHeight = min + rand() % ((max+ 1) - min);
+		//Makes the back snapshot the newest one
+		void publish();
 
-        if (i != 0)
-        {
-            lights[i].mPosX = lights[i - 1].mPosX + lights[i].LIGHTS_WIDTH + 250;
-            lights[i].shiftColliders();
-        }
+		//Takes the newest snapshot if one was published since, false when the front is still the latest
+		bool acquire();
 
-        lights[i].mPosY = (randomHeight * -1);
-        lights[i].shiftColliders();
-    }
-}
+		//Gets the snapshot the renderer draws
+		const WorldSnapshot& getFront();
+
+	private:
+		//Middle slot index, with FRESH set while the renderer hasn't taken it
+		static const int FRESH = 4;
+		static const int INDEX_MASK = 3;
+
+		WorldSnapshot mSlots[ 3 ];
+		int mBack;
+		int mFront;
+		SDL_atomic_t mMiddle;
+};
 
-bool checkCollision(std::vector<SDL_Rect> &roach, std::vector<SDL_Rect> &obstacle) //std::vector<SDL_Rect> &shelf, std::vector<SDL_Rect> &lights)
+//Everything a game session simulates, free of the window and textures
+class World
 {
-    //The sides of the roach's colliders
-    int leftRoach;
-    int rightRoach;
-    int topRoach;
-    int bottomRoach;
+    public:
+		//The roach, shelves and lights, one pool per kind. Obstacle rings are sorted by x
+		EntityPool entities[NUM_OF_ENTITY_KINDS];
 
-    //The sides of the obstacle's colliders
-    int leftObstacle;
-    int rightObstacle;
-    int topObstacle;
-    int bottomObstacle;
+		//Hitboxes of the obstacles the broad phase let through, and which obstacle each belongs to
+		ColliderStore narrowPhase;
+		std::vector<EntityRef> candidates;
 
-    for (int obstacleColliderIdx = 0; obstacleColliderIdx < obstacle.size(); obstacleColliderIdx++)
-    {
-        //determine the sides of obstacle's colliders
-        leftObstacle = obstacle[obstacleColliderIdx].x;
-        rightObstacle = obstacle[obstacleColliderIdx].x + obstacle[obstacleColliderIdx].w;
-        topObstacle = obstacle[obstacleColliderIdx].y;
-        bottomObstacle = obstacle[obstacleColliderIdx].y + obstacle[obstacleColliderIdx].h;
+		//Distance the background has scrolled, now and before the last step
+		double scrolled, prevScrolled;
 
-        for (int roachColliderIdx = 0; roachColliderIdx < roach.size(); roachColliderIdx++)
-        {
-            //determine the sides of roach's colliders
-            leftRoach = roach[roachColliderIdx].x;
-            rightRoach = roach[roachColliderIdx].x + roach[roachColliderIdx].w;
-            topRoach = roach[roachColliderIdx].y;
-            bottomRoach = roach[roachColliderIdx].y + roach[roachColliderIdx].h;
+		//Simulation ticks since the game started
+		Uint32 tick;
 
-            //If no sides from roach's are outside of shelf's
-            if( ( ( bottomRoach <= topObstacle ) || ( topRoach >= bottomObstacle ) || ( rightRoach <= leftObstacle ) || ( leftRoach >= rightObstacle ) ) == false )
-            {
-                return true;
-            }
-        }
-    }
+		Uint32 score;
 
-    //If neither set of collision boxes touched
-    return false;
-}
+		//Set once the roach hits something
+		bool ended;
 
-void showMenu()
-{
-    Uint32 time;
-    int x;
-    int y;
-    const char *labels[NUM_OF_MENU] = {"New Game", "High Score", "Exit"};
-    bool isSelected[NUM_OF_MENU] = {false, false, false};
-    SDL_Color color[2] = {{0, 0, 0}, {193, 0, 0}};
+		//Obstacle layout generator
+		ObstacleGenerator generator;
 
-    int offset1 = 50;
-    int offset2 = 0;
+		//Per-phase time totals a simulation thread keeps itself, NULL times into the profiler
+		Uint64* phaseTimes;
 
-    for (int i = 0; i < NUM_OF_MENU; ++i)
-    {
-        if( !gMenuTexture[i].loadFromRenderedText(labels[i], color[0]) )
-        {
-            printf( "Unable to render menu texture!\n" );
-        }
+		World();
 
-        gMenuTexture[i].setX(( SCREEN_WIDTH - gMenuTexture[i].getWidth() ) / 2);
-        gMenuTexture[i].setY((offset2 + (100 + SCREEN_HEIGHT - gMenuTexture[i].getHeight() ) / 2 ) - offset1);
-        offset1 -= 10;
-        offset2 += gMenuTexture[i].getHeight();
-    }
+		//Starts a new game with the given layout seed and settings
+		void reset( Uint32 seed, const ObstacleSettings &settings );
 
-    SDL_Event e;
+		//Applies a player input, false when it didn't change the roach's velocity
+		bool handleInput( InputAction action );
 
-    while(1)
-    {
-        time = SDL_GetTicks();
+		//Advances the game by one fixed step
+		void step( float dt );
 
-        while(SDL_PollEvent(&e))
-        {
-            switch(e.type) {
-            case SDL_QUIT:
-                return;
-            case SDL_MOUSEMOTION:
-                SDL_GetMouseState( &x, &y );
+		//Copies the entities on screen and their last two positions for the renderer
+		void capture( WorldSnapshot &snapshot );
 
-                for (int i = 0; i < NUM_OF_MENU; ++i)
-                {
-                    if (x >= gMenuTexture[i].getX() && x <= gMenuTexture[i].getX() + gMenuTexture[i].getWidth() &&
-                        y >= gMenuTexture[i].getY() && y <= gMenuTexture[i].getY() + gMenuTexture[i].getHeight())
-                    {
-                        if (!isSelected[i])
-                        {
-                            isSelected[i] = true;
-                            if( !gMenuTexture[i].loadFromRenderedText(labels[i], color[1]) )
-                            {
-                                printf( "Unable to render menu texture!\n" );
-                            }
-                        }
-                    }
-                    else
-                    {
-                        if (isSelected[i])
-                        {
-                            isSelected[i] = false;
-                            if( !gMenuTexture[i].loadFromRenderedText(labels[i], color[0]) )
-                            {
-                                printf( "Unable to render menu texture!\n" );
-                            }
-                        }
-                    }
-                }
-                break;
-            case  SDL_MOUSEBUTTONDOWN:
-                SDL_GetMouseState( &x, &y );
+		//Pixels beyond the screen edges an interpolated obstacle may still show at
+		static const int RENDER_MARGIN = 16;
 
-                for (int i = 0; i < NUM_OF_MENU; ++i)
-                {
-                    if (x >= gMenuTexture[i].getX() && x <= gMenuTexture[i].getX() + gMenuTexture[i].getWidth() &&
-                        y >= gMenuTexture[i].getY() && y <= gMenuTexture[i].getY() + gMenuTexture[i].getHeight())
-                    {
-                        if (i == 0)
-                        {
-                            do {
-                                startGame();
-                            }while(showScore() == 99);
-                        }
-                        else if (i == 1)
-                        {
-                            showScore(true);
-                        }
-                        else if (i == 2)
-                        {
-                            return;
-                        }
-                    }
-                }
-            }
-        }
+    private:
+		//Gains velocity up to each kind's cap
+		void accelerate( float dt );
 
-        //Clear screen
-        SDL_SetRenderDrawColor( gRenderer, 239, 228, 176, 0x0 );
-        SDL_RenderClear( gRenderer );
+		//Moves every entity along its kind's direction
+		void move( float dt );
 
-        gCockyTexture.render((SCREEN_WIDTH - gCockyTexture.getWidth()) / 2, 50);
-        for (int i = 0; i < NUM_OF_MENU; ++i)
-        {
-            gMenuTexture[i].render(gMenuTexture[i].getX(), gMenuTexture[i].getY());
-        }
-        //Update screen
-        SDL_RenderPresent( gRenderer );
+		//Retires obstacles that left the screen and generates new ones
+		void stream();
 
-        if(1000/30 > (SDL_GetTicks()-time))
-            SDL_Delay(1000/30 - (SDL_GetTicks()-time));
-    }
-}
+		//Checks the roach against the screen edges and the obstacles
+		bool collide();
 
-void startGame()
-{
-    //Main loop flag
-    bool quit = false;
+		//Finds the live entities of a kind whose collision boxes overlap [minX, maxX) horizontally,
+		//as the range [first, last) of ring positions
+		void findOverlapping( int kind, int minX, int maxX, int &first, int &last );
 
-    //Event handler
-    SDL_Event e;
+		//Moves a box relative to an entity into world coordinates
+		SDL_Rect place( int kind, int index, const SDL_Rect &box );
 
-    //The roach, shelf and lights that will be moving around on the screen
-    Roach roach;
-    Shelf shelf_arr[NUM_OF_OBSTACLES];
-    Lights lights_arr[NUM_OF_OBSTACLES];
+		//Checks the roach's mask against an obstacle's
+		bool masksOverlap( const EntityRef &obstacle );
+};
 
-    currentScore = 0;
-    endGame = false;
-    startTime = SDL_GetTicks();
+//Screens the main loop switches between
+enum SceneId
+{
+	SCENE_MENU,
+	SCENE_LOADING,
+	SCENE_GAME,
+	SCENE_SCORE,
+	SCENE_HIGH_SCORE,
+	SCENE_QUIT,
+	NUM_OF_SCENES = SCENE_QUIT
+};
 
-    randomise_shelf(shelf_arr);
-    randomise_lights(lights_arr);
+//A screen driven by runScenes, returning the scene to switch to from its handlers
+class Scene
+{
+	public:
+		//Initializes variables
+		Scene( const char* name );
+		virtual ~Scene();
 
-    //The background scrolling offset
-    int scrollingOffset = 0;
+		//Called each time the scene is switched to
+		virtual void enter();
 
-    Uint32 oldTick = SDL_GetTicks();
+		//Handles one event
+		virtual SceneId handleEvent( SDL_Event& e ) = 0;
 
-    //While application is running
-    while( !quit )
-    {
-        //Handle events on queue
-        while( SDL_PollEvent( &e ) != 0 )
-        {
-            //User requests quit
-            if( e.type == SDL_QUIT )
-            {
-                quit = true;
-            }
+		//Advances the scene once per loop iteration
+		virtual SceneId update() = 0;
 
-            //Handle input for the roach
-            roach.handleEvent( e );
-        }
+		//How long the loop may sleep waiting for events while nothing needs drawing
+		virtual Uint32 getWaitTimeout();
 
-        //Apply acceleration and gravity
-        Uint32 currentTick = SDL_GetTicks();
-        for (Uint32 i = oldTick; i < currentTick; ++i)
-        {
-            roach.gravitate();
+		//Most frames presented per second, 0 leaves it to the present
+		virtual int getFrameRate();
 
-            for (int j = 0; j < NUM_OF_OBSTACLES; ++j)
-            {
-                shelf_arr[j].accelerate();
-                lights_arr[j].accelerate();
-            }
-        }
-        oldTick = currentTick;
+		//Whether the screen is out of date
+		virtual bool needsRender();
 
-        roach.move(roach.getColliders(), roach.getColliders());
-        for (int j = 0; j < NUM_OF_OBSTACLES; ++j)
-        {
-            shelf_arr[j].move(roach.getColliders());
-            lights_arr[j].move(shelf_arr[j].mPosX, shelf_arr[j].mPosY, roach.getColliders());
-        }
+		//Draws and presents the scene
+		virtual void render() = 0;
 
-        //Scroll background
-        --scrollingOffset;
-        if( scrollingOffset <= -gBGTexture.getWidth() )
-        {
-            scrollingOffset = 0;
-        }
+		//Forces a redraw, when the window was exposed or resized
+		void invalidate();
 
-        //Scoring
-        calculateScore();
+		//Tells the scene whether the window can be seen and has the keyboard
+		virtual void setWindowState( bool visible, bool focused );
 
-        //Clear screen
-        SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
-        SDL_RenderClear( gRenderer );
+		//Trace label of the scene's loop iterations
+		const char* getName();
 
-        //Render background
-        gBGTexture.render( scrollingOffset, 0 );
-        gBGTexture.render( scrollingOffset + gBGTexture.getWidth(), 0 );
+	protected:
+		const char* mName;
+		bool mDirty;
+};
 
-        //Render objects
-        roach.render();
-        for (int j = 0; j < NUM_OF_OBSTACLES; ++j)
-        {
-            shelf_arr[j].render();
-            lights_arr[j].render(false);
-        }
+//Title logo and menu, redrawn when the hover changes
+class MenuScene : public Scene
+{
+	public:
+		//Lays the items out, the font must be loaded
+		MenuScene();
 
-        gScoreTexture.render(10, 10);
+		SceneId handleEvent( SDL_Event& e );
+		SceneId update();
+		Uint32 getWaitTimeout();
+		void render();
 
-        //Update screen
-        SDL_RenderPresent( gRenderer );
+	private:
+		//Index of the menu item under the cursor, or -1
+		int findItem( int x, int y );
+
+		const char* mLabels[ NUM_OF_MENU ];
+		SDL_Rect mItemRects[ NUM_OF_MENU ];
+		int mHovered;
+
+		//Sprites uploaded when the menu was last drawn
+		int mLoadedCount;
+};
+
+//Progress bar shown until every sprite is loaded
+class LoadingScene : public Scene
+{
+	public:
+		LoadingScene();
+
+		void enter();
+		SceneId handleEvent( SDL_Event& e );
+		SceneId update();
+		Uint32 getWaitTimeout();
+		void render();
+
+	private:
+		int mLoadedCount;
+};
+
+//One game session, simulated at a fixed rate on its own thread and drawn every frame
+class GameScene : public Scene
+{
+	public:
+		GameScene();
+		~GameScene();
+
+		void enter();
+		SceneId handleEvent( SDL_Event& e );
+		SceneId update();
+		Uint32 getWaitTimeout();
+		int getFrameRate();
+		void render();
+
+		//Pauses while the window is hidden, or unfocused unless replaying
+		void setWindowState( bool visible, bool focused );
+
+		//Prints how long flaps took to reach the screen this session, for --latency
+		void reportLatency();
+
+		//Prints the frame time jitter of the session, for --pacing-report
+		void reportPacing();
+
+		//Whether a replay diverged or created textures while playing
+		bool hasReplayFailed();
+
+	private:
+		//Simulation thread body
+		static int simulate( void* data );
+
+		//Steps the ticks that are due, applying each queued input right before the first tick
+		//that starts after it happened, and publishes the last one. False once the game ended.
+		//Simulation side only
+		bool advance();
+
+		//Stops the simulation thread and waits for it
+		void stopSimulation();
+
+		//Saves the recording, reports a replay or submits the score
+		void finish();
+
+		//Prints the frame times of a replay, false when it created textures while playing
+		bool report();
+
+		//The simulated game and the inputs of it for --record, owned by the simulation thread while it runs
+		World mWorld;
+		Recording mRecording;
+
+		//Snapshots passed from the simulation to the renderer
+		SnapshotBuffer mSnapshots;
+
+		//Simulation thread, NULL when the main thread steps the world itself
+		SDL_Thread* mThread;
+
+		//Keyboard inputs queued by the main thread, and those the simulation took that are still
+		//ahead of its clock. Both in the order they happened
+		std::vector<TimedInput> mInputs;
+		std::vector<TimedInput> mPending;
+		SDL_mutex* mInputLock;
+
+		//Posted to wake the simulation early
+		SDL_sem* mWake;
+
+		//Set to stop the simulation, hold it while the window is away and restart its clock
+		SDL_atomic_t mQuit;
+		SDL_atomic_t mHeld;
+		SDL_atomic_t mResumed;
+
+		//Next recorded input for --replay
+		size_t mReplayPos;
+
+		//Real time not yet simulated and when it was last counted
+		Uint64 mAccumulator;
+		Uint64 mOldCounter;
+
+		//Flaps the simulation applied and when the latest were pressed, simulation side
+		Uint32 mFlaps;
+		Uint64 mFlapTimes[ FLAP_TIME_SLOTS ];
+
+		//Flaps already on screen, their input to present latencies in milliseconds over the session
+		//and how many more went up than a snapshot could time
+		Uint32 mFlapsShown;
+		std::vector<float> mLatencies;
+		Uint32 mUntimedFlaps;
+
+		//Phase totals the world times into, and how much of them the profiler has been given
+		Uint64 mPhaseTimes[ NUM_OF_PHASES ];
+		Uint64 mProfiledTimes[ NUM_OF_PHASES ];
+
+		//Presented frame durations over the session, in milliseconds, and where each game starts
+		std::vector<float> mFrameTimes;
+		std::vector<size_t> mGameStarts;
+		Uint64 mLastPresent;
+
+		//Textures created while playing, should stay at zero
+		Uint32 mGameplayCreations;
+
+		//Games saved for --record this session
+		Uint32 mGamesRecorded;
+
+		//Set when a replay ended differently or created textures while playing
+		bool mReplayFailed;
+
+		//Whether the frame the game ended on went up, the ended game was handled, and when
+		bool mEndShown;
+		bool mFinished;
+		Uint32 mFinishTime;
+
+		//Whether the game is held while the window is away
+		bool mPaused;
+};
+
+//Result of the last game, or the best score from the menu
+class ScoreScene : public Scene
+{
+	public:
+		ScoreScene( bool isHighScore );
+
+		void enter();
+		SceneId handleEvent( SDL_Event& e );
+		SceneId update();
+		void render();
+
+	private:
+		bool mIsHighScore;
+
+		//Lines formatted once on entry
+		char mScore[ 30 ];
+		char mStanding[ 80 ];
+		const char* mMessage;
+};
+
+//Reads command line options
+bool parseOptions( int argc, char* args[] );
+
+//Starts up SDL and creates window
+bool init();
+
+//Loads a color keyed image at specified path
+SDL_Surface* loadSurface( std::string path );
+
+//Loads media, returns once the menu can be drawn
+bool loadMedia();
+
+//Decodes the PNGs and font into the asset archive
+int writeAssetPack();
+
+//Decodes a sprite to ARGB8888, from the asset archive when it is open
+SDL_Surface* decodeSprite( SpriteId sprite );
+
+//Builds the collision masks and hitboxes of every kind drawn with the sprite
+bool buildCollisionMasks( SpriteId sprite, SDL_Surface* surface );
+
+//Decodes just the sprites that collide, for runs without the asset loader
+bool loadCollisionMasks();
+
+//Prints how well each hitbox budget covers the sprites
+int reportHitboxes();
+
+//Checks every collision kernel the CPU runs against the scalar one
+int testCollideKernels();
+
+//Frees media and shuts down SDL
+void close();
+
+//Picks a height for a respawned shelf
+float randomShelfY(Random &rng);
+
+//Picks a height for lights respawned over a shelf at the given height
+float randomLightsY(int shelf_y_position, Random &rng);
+
+//Maps a key event to a simulation input
+bool translateInput( SDL_Event& e, InputAction& action );
+
+//Renders a snapshot's background and objects, interpolated between its two ticks
+void renderSnapshot( const WorldSnapshot &snapshot, float alpha );
+
+//Runs the scenes from the given one until one quits, false when a replay failed
+bool runScenes( SceneId first );
+
+//Submits the finished game's score to the score history
+void evaluateScore();
+
+//Calculate Score after a simulation tick
+void calculateScore(World &world);
+
+//Reads a text input script of "<tick> press|release" lines
+bool loadInputScript( std::string path, std::vector<ScriptedInput>& script );
+
+//Runs the simulation benchmark without a window
+int runHeadless();
+
+//Little-endian words for the binary file formats
+void writeUint32( std::vector<Uint8>& out, Uint32 value );
+bool readUint32( const std::vector<Uint8>& in, size_t& pos, Uint32& value );
+
+//Reads a whole file, false if it can't be opened
+bool readFile( std::string path, std::vector<Uint8>& data );
+
+//Flushes a file's writes to the disk
+bool syncFile( FILE* file );
+
+//Writes data to a temporary file and renames it over path, so a crash leaves the old contents or the new
+bool replaceFile( std::string path, const std::vector<Uint8>& data );
+
+//Writes and reads recorded games
+bool saveRecording( std::string path, const Recording& recording );
+bool loadRecording( std::string path, Recording& recording );
+
+//Prints mean, median, 99th percentile and worst frame time
+void reportFrameTimes( std::vector<float>& frameTimes );
+
+//Prints how evenly frames were delivered, then their distribution. Frame to frame
+//changes aren't taken across the game starts, given as indices into the frame times
+void reportPacing( std::vector<float>& frameTimes, const std::vector<size_t>& gameStarts );
+
+//Names the pacing mode in effect, for reports
+void describePacing( char* text );
+
+//Falls back to the nearest pacing the renderer supports and settles the limiter's rate
+void resolvePacing();
+
+//The window we'll be rendering to
+SDL_Window* gWindow = NULL;
+
+//The window renderer
+SDL_Renderer* gRenderer = NULL;
+
+//Globally used font
+TTF_Font *gFont = NULL;
+
+//Sprite image files, in SpriteId order
+const char* SPRITE_PATHS[ NUM_OF_SPRITES ] = { "00_cocky_roach/roach.png", "00_cocky_roach/bg.png", "00_cocky_roach/obstacle.png", "00_cocky_roach/lights.png", "00_cocky_roach/cocky_roach.png" };
+
+//Font file and size
+const char* FONT_PATH = "00_cocky_roach/lazy.ttf";
+const int FONT_SIZE = 28;
+
+//Pre-decoded sprites and font, preferred over the files above when present
+const char* ASSET_PACK_PATH = "00_cocky_roach/assets.pak";
+LAssetPack gAssetPack;
+
+//Collision masks and hitboxes of every entity kind, built from the sprites at load time
+CollisionMask gEntityMasks[ NUM_OF_ENTITY_KINDS ];
+std::vector<SDL_Rect> gEntityHitboxes[ NUM_OF_ENTITY_KINDS ];
+
+//Hitbox budget and whether collision stops at the boxes
+CollisionSettings gCollisionSettings = { DEFAULT_NUM_OF_HITBOXES, false };
+
+//Print the hitbox coverage of every budget and exit
+bool gReportHitboxes = false;
+
+//Check the vector collision kernels and exit
+bool gTestCollide = false;
+
+//Random box sets --collide-selftest runs, and most boxes in one
+const int COLLIDE_TEST_SETS = 20000;
+const int COLLIDE_TEST_MAX_BOXES = 4 * ColliderStore::LANES + 3;
+
+//Alpha at or above which a pixel collides
+const Uint32 MASK_ALPHA_THRESHOLD = 128;
+
+//Write the asset archive and exit
+bool gWritePack = false;
+
+//Scene sprites
+LSpriteAtlas gSpriteAtlas;
+
+//Streams sprites into the atlas in the background
+LAssetLoader gAssetLoader;
+
+//Game background, cached in render targets
+LParallaxLayers gBackgroundLayers;
+
+//Score history snapshot and log, and the single high score file they replace
+const char* SCORE_HISTORY_PATH = "scores.hist";
+const char* SCORE_LOG_PATH = "scores.log";
+const char* HIGH_SCORE_PATH = "hs.hs";
+LScoreHistory gScoreHistory;
+
+//HUD, score and menu text
+LTextAtlas gTextAtlas;
+
+//Game loop phase timings, toggled with F3
+Profiler gProfiler;
+bool gShowProfiler = false;
+
+//Profiler phase labels
+const char* PHASE_NAMES[ NUM_OF_PHASES ] = { "events", "physics", "collision", "score", "background", "sprites", "hud", "present" };
+
+//Session trace for --trace
+TraceBuffer gTrace;
+std::string gTracePath;
+
+//Log renderer statistics once a second
+bool gLogRenderStats = false;
+
+//Simulation steps per second
+int gTickRate = DEFAULT_TICK_RATE;
+
+//Obstacle generator settings
+ObstacleSettings gObstacleSettings = { DEFAULT_NUM_OF_OBSTACLES, DEFAULT_OBSTACLE_SPACING, DEFAULT_OBSTACLE_DENSITY };
+
+//Collision kernel forced with --collide, otherwise the best the CPU runs
+bool gCollideKernelSet = false;
+
+//Most real time a single frame may catch up on
+int gMaxCatchUpMs = DEFAULT_MAX_CATCH_UP_MS;
+
+//Frame pacing mode, and the limiter's frames per second, 0 until resolved
+PacingMode gPacing = PACING_VSYNC;
+int gFrameCap = 0;
+const char* PACING_NAMES[ NUM_OF_PACING_MODES ] = { "vsync", "adaptive", "uncapped", "limiter" };
+
+//Print frame time jitter on exit
+bool gReportPacing = false;
+
+//Time each flap from key press to present, for --latency
+bool gMeasureLatency = false;
+
+//Headless benchmark settings
+bool gHeadless = false;
+Uint32 gBenchTicks = DEFAULT_BENCH_TICKS;
+int gBenchThreads = 0;
+Uint32 gBenchSeed = 1;
+std::vector<ScriptedInput> gInputScript;
+
+//Game recording and replay
+std::string gRecordPath;
+bool gReplaying = false;
+Recording gReplay;
+
+Uint32 currentScore;
+
+RenderStats LTexture::sCurrentStats = { 0, 0, 0, 0 };
+RenderStats LTexture::sFrameStats = { 0, 0, 0, 0 };
+RenderStats LTexture::sTotalStats = { 0, 0, 0, 0 };
+Uint64 LTexture::sLiveBytes = 0;
+Uint32 LTexture::sLogFrames = 0;
+RenderStats LTexture::sLogStats = { 0, 0, 0, 0 };
+Uint64 LTexture::sLogStart = 0;
+
+LTexture::LTexture()
+{
+	//Initialize
+	mTexture = NULL;
+	mWidth = 0;
+	mHeight = 0;
+	mBytes = 0;
+}
+
+LTexture::~LTexture()
+{
+	//Deallocate
+	free();
+}
+
+bool LTexture::loadFromSurface( SDL_Surface* surface )
+{
+	//Get rid of preexisting texture
+	free();
+
+	//Create texture from surface pixels
+	mTexture = SDL_CreateTextureFromSurface( gRenderer, surface );
+	if( mTexture == NULL )
+	{
+		printf( "Unable to create texture from surface! SDL Error: %s\n", SDL_GetError() );
+	}
+	else
+	{
+		//Get image dimensions
+		mWidth = surface->w;
+		mHeight = surface->h;
+
+		countCreation();
+	}
+
+	//Return success
+	return mTexture != NULL;
+}
+
+bool LTexture::createBlank( int width, int height )
+{
+	//Get rid of preexisting texture
+	free();
+
+	mTexture = SDL_CreateTexture( gRenderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, width, height );
+	if( mTexture == NULL )
+	{
+		printf( "Unable to create blank texture! SDL Error: %s\n", SDL_GetError() );
+		return false;
+	}
+
+	mWidth = width;
+	mHeight = height;
+	SDL_SetTextureBlendMode( mTexture, SDL_BLENDMODE_BLEND );
+
+	//Static textures start out undefined, clear them once
+	std::vector<Uint32> clear( (size_t)width * height, 0 );
+	SDL_UpdateTexture( mTexture, NULL, &clear[ 0 ], width * 4 );
+
+	countCreation();
+
+	return true;
+}
+
+bool LTexture::createTarget( int width, int height )
+{
+	//Get rid of preexisting texture
+	free();
+
+	mTexture = SDL_CreateTexture( gRenderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, width, height );
+	if( mTexture == NULL )
+	{
+		printf( "Unable to create target texture! SDL Error: %s\n", SDL_GetError() );
+		return false;
+	}
+
+	mWidth = width;
+	mHeight = height;
+	SDL_SetTextureBlendMode( mTexture, SDL_BLENDMODE_BLEND );
+
+	countCreation();
+
+	return true;
+}
+
+bool LTexture::setAsRenderTarget()
+{
+	if( SDL_SetRenderTarget( gRenderer, mTexture ) != 0 )
+	{
+		printf( "Unable to render to texture! SDL Error: %s\n", SDL_GetError() );
+		return false;
+	}
+
+	return true;
+}
+
+void LTexture::resetRenderTarget()
+{
+	SDL_SetRenderTarget( gRenderer, NULL );
+}
+
+bool LTexture::update( const SDL_Rect& rect, const void* pixels, int pitch )
+{
+	if( SDL_UpdateTexture( mTexture, &rect, pixels, pitch ) != 0 )
+	{
+		printf( "Unable to update texture! SDL Error: %s\n", SDL_GetError() );
+		return false;
+	}
+
+	sCurrentStats.bytesUploaded += (Uint64)rect.w * rect.h * 4;
+	return true;
+}
+
+void LTexture::free()
+{
+	//Free texture if it exists
+	if( mTexture != NULL )
+	{
+		SDL_DestroyTexture( mTexture );
+		mTexture = NULL;
+		mWidth = 0;
+		mHeight = 0;
+
+		++sCurrentStats.textureDestructions;
+		sLiveBytes -= mBytes;
+		mBytes = 0;
+	}
+}
+
+void LTexture::render( int x, int y, SDL_Rect* clip, double angle, SDL_Point* center, SDL_RendererFlip flip )
+{
+	//Set rendering space and render to screen
+	SDL_Rect renderQuad = { x, y, mWidth, mHeight };
+
+	//Set clip rendering dimensions
+	if( clip != NULL )
+	{
+		renderQuad.w = clip->w;
+		renderQuad.h = clip->h;
+	}
+
+	//Render to screen
+	SDL_RenderCopyEx( gRenderer, mTexture, clip, &renderQuad, angle, center, flip );
+	++sCurrentStats.drawCalls;
+}
+
+void LTexture::renderGeometry( const SDL_Vertex* vertices, int numVertices, const int* indices, int numIndices )
+{
+	//Render the whole batch to screen
+	SDL_RenderGeometry( gRenderer, mTexture, vertices, numVertices, indices, numIndices );
+	++sCurrentStats.drawCalls;
+}
+
+void LTexture::countCreation()
+{
+	//Size the texture by its actual pixel format
+	Uint32 format = SDL_PIXELFORMAT_ARGB8888;
+	SDL_QueryTexture( mTexture, &format, NULL, NULL, NULL );
+	int bytesPerPixel = SDL_BYTESPERPIXEL( format ) > 0 ? SDL_BYTESPERPIXEL( format ) : 4;
+	mBytes = (Uint64)mWidth * mHeight * bytesPerPixel;
+
+	++sCurrentStats.textureCreations;
+	sCurrentStats.bytesUploaded += mBytes;
+	sLiveBytes += mBytes;
+}
+
+void LTexture::endStatsFrame()
+{
+	sFrameStats = sCurrentStats;
+
+	sTotalStats.drawCalls += sCurrentStats.drawCalls;
+	sTotalStats.textureCreations += sCurrentStats.textureCreations;
+	sTotalStats.textureDestructions += sCurrentStats.textureDestructions;
+	sTotalStats.bytesUploaded += sCurrentStats.bytesUploaded;
+
+	sCurrentStats.drawCalls = 0;
+	sCurrentStats.textureCreations = 0;
+	sCurrentStats.textureDestructions = 0;
+	sCurrentStats.bytesUploaded = 0;
+
+	if( !gLogRenderStats )
+	{
+		return;
+	}
+
+	//Sum up frames until a second has passed
+	++sLogFrames;
+	sLogStats.drawCalls += sFrameStats.drawCalls;
+	sLogStats.textureCreations += sFrameStats.textureCreations;
+	sLogStats.textureDestructions += sFrameStats.textureDestructions;
+	sLogStats.bytesUploaded += sFrameStats.bytesUploaded;
+
+	Uint64 now = SDL_GetPerformanceCounter();
+	if( sLogStart == 0 )
+	{
+		sLogStart = now;
+	}
+	else if( now - sLogStart >= SDL_GetPerformanceFrequency() )
+	{
+		printf( "render: %u frames, %.1f draw calls/frame, %u texture creations, %u destructions, %llu bytes uploaded, %.2f MB live\n",
+				sLogFrames, (double)sLogStats.drawCalls / sLogFrames, sLogStats.textureCreations, sLogStats.textureDestructions,
+				(unsigned long long)sLogStats.bytesUploaded, sLiveBytes / ( 1024.0 * 1024.0 ) );
+
+		sLogFrames = 0;
+		sLogStats.drawCalls = 0;
+		sLogStats.textureCreations = 0;
+		sLogStats.textureDestructions = 0;
+		sLogStats.bytesUploaded = 0;
+		sLogStart = now;
+	}
+}
+
+const RenderStats& LTexture::getFrameStats()
+{
+	return sFrameStats;
+}
+
+const RenderStats& LTexture::getTotalStats()
+{
+	return sTotalStats;
+}
+
+Uint64 LTexture::getLiveTextureBytes()
+{
+	return sLiveBytes;
+}
+
+int LTexture::getWidth()
+{
+	return mWidth;
+}
+
+int LTexture::getHeight()
+{
+	return mHeight;
+}
+
+LSpriteAtlas::LSpriteAtlas()
+{
+	//Initialize
+	free();
+}
+
+bool LSpriteAtlas::create()
+{
+	//Get rid of preexisting atlas
+	free();
+
+	//Don't go past what the renderer can hold
+	int atlasWidth = MAX_ATLAS_SIZE;
+	int atlasHeight = MAX_ATLAS_SIZE;
+	SDL_RendererInfo info;
+	if( SDL_GetRendererInfo( gRenderer, &info ) == 0 )
+	{
+		if( info.max_texture_width > 0 && info.max_texture_width < atlasWidth )
+		{
+			atlasWidth = info.max_texture_width;
+		}
+		if( info.max_texture_height > 0 && info.max_texture_height < atlasHeight )
+		{
+			atlasHeight = info.max_texture_height;
+		}
+	}
+
+	//Room for a typical frame up front
+	mVertices.reserve( 64 * 4 );
+	mIndices.reserve( 64 * 6 );
+
+	return mTexture.createBlank( atlasWidth, atlasHeight );
+}
+
+bool LSpriteAtlas::add( SpriteId sprite, SDL_Surface* surface )
+{
+	//Start a new shelf when the current one is full
+	if( mPenX + surface->w + PADDING * 2 > mTexture.getWidth() )
+	{
+		mPenX = 0;
+		mPenY += mRowHeight;
+		mRowHeight = 0;
+	}
+
+	if( surface->w + PADDING * 2 > mTexture.getWidth() || mPenY + surface->h + PADDING * 2 > mTexture.getHeight() )
+	{
+		printf( "Sprite atlas is full!\n" );
+		return false;
+	}
+
+	SDL_Rect clip = { mPenX + PADDING, mPenY + PADDING, surface->w, surface->h };
+
+	//Pixels go straight from the decoded surface to the texture
+	if( SDL_MUSTLOCK( surface ) )
+	{
+		SDL_LockSurface( surface );
+	}
+	bool success = mTexture.update( clip, surface->pixels, surface->pitch );
+	if( SDL_MUSTLOCK( surface ) )
+	{
+		SDL_UnlockSurface( surface );
+	}
+
+	if( success )
+	{
+		mClips[ sprite ] = clip;
+
+		mPenX += surface->w + PADDING * 2;
+		if( surface->h + PADDING * 2 > mRowHeight )
+		{
+			mRowHeight = surface->h + PADDING * 2;
+		}
+	}
+
+	return success;
+}
+
+bool LSpriteAtlas::isLoaded( SpriteId sprite )
+{
+	return mClips[ sprite ].w > 0;
+}
+
+void LSpriteAtlas::free()
+{
+	mTexture.free();
+	mVertices.clear();
+	mIndices.clear();
+
+	for( int i = 0; i < NUM_OF_SPRITES; ++i )
+	{
+		mClips[ i ].x = 0;
+		mClips[ i ].y = 0;
+		mClips[ i ].w = 0;
+		mClips[ i ].h = 0;
+	}
+
+	mPenX = 0;
+	mPenY = 0;
+	mRowHeight = 0;
+}
+
+void LSpriteAtlas::draw( SpriteId sprite, int x, int y, SDL_RendererFlip flip )
+{
+	const SDL_Rect& clip = mClips[ sprite ];
+
+	//Still streaming in
+	if( clip.w == 0 )
+	{
+		return;
+	}
+
+	float atlasWidth = (float)mTexture.getWidth();
+	float atlasHeight = (float)mTexture.getHeight();
+
+	float left = (float)x;
+	float top = (float)y;
+	float right = left + clip.w;
+	float bottom = top + clip.h;
+
+	float u0 = clip.x / atlasWidth;
+	float v0 = clip.y / atlasHeight;
+	float u1 = ( clip.x + clip.w ) / atlasWidth;
+	float v1 = ( clip.y + clip.h ) / atlasHeight;
+
+	//Mirror by swapping texture coordinates
+	if( flip & SDL_FLIP_HORIZONTAL )
+	{
+		std::swap( u0, u1 );
+	}
+	if( flip & SDL_FLIP_VERTICAL )
+	{
+		std::swap( v0, v1 );
+	}
+
+	int first = (int)mVertices.size();
+	SDL_Color white = { 0xFF, 0xFF, 0xFF, 0xFF };
+	SDL_Vertex quad[ 4 ] =
+	{
+		{ { left, top }, white, { u0, v0 } },
+		{ { right, top }, white, { u1, v0 } },
+		{ { right, bottom }, white, { u1, v1 } },
+		{ { left, bottom }, white, { u0, v1 } }
+	};
+	mVertices.insert( mVertices.end(), quad, quad + 4 );
+
+	int indices[ 6 ] = { first, first + 1, first + 2, first, first + 2, first + 3 };
+	mIndices.insert( mIndices.end(), indices, indices + 6 );
+}
+
+void LSpriteAtlas::flush()
+{
+	if( !mVertices.empty() )
+	{
+		mTexture.renderGeometry( &mVertices[ 0 ], (int)mVertices.size(), &mIndices[ 0 ], (int)mIndices.size() );
+	}
+
+	//Keep the capacity for the next frame
+	mVertices.clear();
+	mIndices.clear();
+}
+
+int LSpriteAtlas::getWidth( SpriteId sprite )
+{
+	return mClips[ sprite ].w;
+}
+
+int LSpriteAtlas::getHeight( SpriteId sprite )
+{
+	return mClips[ sprite ].h;
+}
+
+LParallaxLayers::LParallaxLayers()
+{
+	//Initialize
+	mNumOfGroups = 0;
+	mCreated = false;
+	mOpaque = false;
+	mDirty = false;
+	mUseTargets = false;
+}
+
+bool LParallaxLayers::create()
+{
+	if( mCreated )
+	{
+		return true;
+	}
+
+	for( int i = 0; i < NUM_OF_PARALLAX_LAYERS; ++i )
+	{
+		if( !gSpriteAtlas.isLoaded( PARALLAX_LAYERS[ i ].sprite ) )
+		{
+			return false;
+		}
+	}
+
+	//Layers only merge with their neighbours, or they would be drawn out of order
+	mNumOfGroups = 0;
+	mOpaque = false;
+	for( int i = 0; i < NUM_OF_PARALLAX_LAYERS; ++i )
+	{
+		const ParallaxLayer& layer = PARALLAX_LAYERS[ i ];
+		int width = gSpriteAtlas.getWidth( layer.sprite );
+
+		//A layer that stands still never wraps
+		int period = layer.rate == 0.0f ? 0 : width;
+
+		if( mNumOfGroups == 0 || PARALLAX_LAYERS[ i - 1 ].rate != layer.rate || mPeriods[ mNumOfGroups - 1 ] != period )
+		{
+			mGroupStarts[ mNumOfGroups ] = i;
+			mPeriods[ mNumOfGroups ] = period;
+			++mNumOfGroups;
+		}
+
+		if( layer.opaque && layer.y <= 0 && layer.y + gSpriteAtlas.getHeight( layer.sprite ) >= SCREEN_HEIGHT )
+		{
+			mOpaque = true;
+		}
+	}
+	mGroupStarts[ mNumOfGroups ] = NUM_OF_PARALLAX_LAYERS;
+
+	mUseTargets = SDL_RenderTargetSupported( gRenderer ) == SDL_TRUE;
+	for( int g = 0; g < mNumOfGroups && mUseTargets; ++g )
+	{
+		if( !mTextures[ g ].createTarget( mPeriods[ g ] + SCREEN_WIDTH, SCREEN_HEIGHT ) )
+		{
+			mUseTargets = false;
+		}
+	}
+
+	if( !mUseTargets )
+	{
+		printf( "Warning: Render targets unavailable, drawing background layers every frame!\n" );
+		for( int g = 0; g < mNumOfGroups; ++g )
+		{
+			mTextures[ g ].free();
+		}
+	}
+
+	mCreated = true;
+	mDirty = true;
+
+	return true;
+}
+
+bool LParallaxLayers::isCreated()
+{
+	return mCreated;
+}
+
+void LParallaxLayers::invalidate()
+{
+	mDirty = true;
+}
+
+bool LParallaxLayers::isOpaque()
+{
+	return mCreated && mOpaque;
+}
+
+void LParallaxLayers::render( double scrolled )
+{
+	if( !mCreated )
+	{
+		return;
+	}
+
+	//Without targets the layers go into the sprite batch every frame
+	if( !mUseTargets )
+	{
+		for( int i = 0; i < NUM_OF_PARALLAX_LAYERS; ++i )
+		{
+			const ParallaxLayer& layer = PARALLAX_LAYERS[ i ];
+			int width = gSpriteAtlas.getWidth( layer.sprite );
+			drawTiled( layer, SCREEN_WIDTH, getOffset( layer, width, scrolled ) );
+		}
+		return;
+	}
+
+	if( mDirty )
+	{
+		redraw();
+	}
+
+	for( int g = 0; g < mNumOfGroups; ++g )
+	{
+		SDL_Rect clip = { getOffset( PARALLAX_LAYERS[ mGroupStarts[ g ] ], mPeriods[ g ], scrolled ), 0, SCREEN_WIDTH, SCREEN_HEIGHT };
+		mTextures[ g ].render( 0, 0, &clip );
+	}
+}
+
+void LParallaxLayers::free()
+{
+	for( int g = 0; g < NUM_OF_PARALLAX_LAYERS; ++g )
+	{
+		mTextures[ g ].free();
+	}
+
+	mNumOfGroups = 0;
+	mCreated = false;
+	mOpaque = false;
+	mDirty = false;
+	mUseTargets = false;
+}
+
+void LParallaxLayers::redraw()
+{
+	TraceScope trace( "redraw layers" );
+
+	for( int g = 0; g < mNumOfGroups; ++g )
+	{
+		if( !mTextures[ g ].setAsRenderTarget() )
+		{
+			continue;
+		}
+
+		//Start from transparent so lower groups show through
+		SDL_SetRenderDrawColor( gRenderer, 0, 0, 0, 0 );
+		SDL_RenderClear( gRenderer );
+
+		for( int i = mGroupStarts[ g ]; i < mGroupStarts[ g + 1 ]; ++i )
+		{
+			drawTiled( PARALLAX_LAYERS[ i ], mTextures[ g ].getWidth(), 0 );
+		}
+		gSpriteAtlas.flush();
+	}
+
+	LTexture::resetRenderTarget();
+	mDirty = false;
+}
+
+void LParallaxLayers::drawTiled( const ParallaxLayer& layer, int width, int offset )
+{
+	int tileWidth = gSpriteAtlas.getWidth( layer.sprite );
+	if( tileWidth <= 0 )
+	{
+		return;
+	}
+
+	for( int x = -offset; x < width; x += tileWidth )
+	{
+		gSpriteAtlas.draw( layer.sprite, x, layer.y );
+	}
+}
+
+int LParallaxLayers::getOffset( const ParallaxLayer& layer, int period, double scrolled )
+{
+	if( period <= 0 )
+	{
+		return 0;
+	}
+
+	return (int)fmod( scrolled * layer.rate, (double)period );
+}
+
+//Asset archives are little-endian: "CRPK", version, byte order of the pixels,
+//sprite count, font offset and size, then per sprite width, height and offset,
+//then per source file, the sprites' PNGs and the font, its size and modification
+//time as low and high words. Pixels are ARGB8888 words with the color key already
+//turned into alpha.
+const char ASSET_PACK_MAGIC[ 4 ] = { 'C', 'R', 'P', 'K' };
+const Uint8 ASSET_PACK_VERSION = 2;
+const int NUM_OF_ASSET_SOURCES = NUM_OF_SPRITES + 1;
+const Uint32 ASSET_PACK_HEADER_SIZE = 24 + NUM_OF_SPRITES * 12 + NUM_OF_ASSET_SOURCES * 12;
+
+//Blobs start on a 16 byte boundary so the mapped pixels are word aligned
+const Uint32 ASSET_PACK_ALIGNMENT = 16;
+
+Uint32 readPackUint32( const Uint8* data )
+{
+	return (Uint32)data[ 0 ] | ( (Uint32)data[ 1 ] << 8 ) | ( (Uint32)data[ 2 ] << 16 ) | ( (Uint32)data[ 3 ] << 24 );
+}
+
+const char* getAssetSourcePath( int source )
+{
+	return source < NUM_OF_SPRITES ? SPRITE_PATHS[ source ] : FONT_PATH;
+}
+
+bool statAssetSource( const char* path, Uint32& size, Uint64& modified )
+{
+#ifdef _WIN32
+	struct _stat64 info;
+	if( _stat64( path, &info ) != 0 )
+	{
+		return false;
+	}
+#else
+	struct stat info;
+	if( stat( path, &info ) != 0 )
+	{
+		return false;
+	}
+#endif
+	size = (Uint32)info.st_size;
+	modified = (Uint64)info.st_mtime;
+	return true;
+}
+
+LAssetPack::LAssetPack()
+{
+	//Initialize
+	mData = NULL;
+	mSize = 0;
+#ifdef _WIN32
+	mFile = INVALID_HANDLE_VALUE;
+	mMapping = NULL;
+#endif
+	mFontOffset = 0;
+	mFontSize = 0;
+}
+
+bool LAssetPack::open( std::string path )
+{
+	//Get rid of preexisting mapping
+	close();
+
+#ifdef _WIN32
+	mFile = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+	if( mFile == INVALID_HANDLE_VALUE )
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if( !GetFileSizeEx( mFile, &fileSize ) || fileSize.QuadPart < ASSET_PACK_HEADER_SIZE )
+	{
+		close();
+		return false;
+	}
+
+	mMapping = CreateFileMappingA( mFile, NULL, PAGE_READONLY, 0, 0, NULL );
+	if( mMapping != NULL )
+	{
+		mData = (const Uint8*)MapViewOfFile( mMapping, FILE_MAP_READ, 0, 0, 0 );
+	}
+	if( mData == NULL )
+	{
+		printf( "Unable to map asset archive %s!\n", path.c_str() );
+		close();
+		return false;
+	}
+	mSize = (size_t)fileSize.QuadPart;
+#else
+	int fd = ::open( path.c_str(), O_RDONLY );
+	if( fd < 0 )
+	{
+		return false;
+	}
+
+	struct stat info;
+	if( fstat( fd, &info ) != 0 || info.st_size < (off_t)ASSET_PACK_HEADER_SIZE )
+	{
+		::close( fd );
+		return false;
+	}
+
+	//The mapping stays valid after the descriptor is closed
+	void* mapped = mmap( NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	::close( fd );
+	if( mapped == MAP_FAILED )
+	{
+		printf( "Unable to map asset archive %s!\n", path.c_str() );
+		return false;
+	}
+
+	//Everything gets read once at startup, let the kernel read ahead
+	madvise( mapped, info.st_size, MADV_WILLNEED );
+
+	mData = (const Uint8*)mapped;
+	mSize = info.st_size;
+#endif
+
+	//Check the header
+	if( memcmp( mData, ASSET_PACK_MAGIC, 4 ) != 0 || mData[ 4 ] != ASSET_PACK_VERSION ||
+		readPackUint32( mData + 8 ) != SDL_BYTEORDER || readPackUint32( mData + 12 ) != NUM_OF_SPRITES )
+	{
+		printf( "%s is not an asset archive for this build, run with --pack to rebuild it!\n", path.c_str() );
+		close();
+		return false;
+	}
+
+	mFontOffset = readPackUint32( mData + 16 );
+	mFontSize = readPackUint32( mData + 20 );
+	bool valid = mFontOffset <= mSize && mFontSize <= mSize - mFontOffset;
+
+	for( int i = 0; i < NUM_OF_SPRITES; ++i )
+	{
+		const Uint8* entry = mData + 24 + i * 12;
+		Uint32 width = readPackUint32( entry );
+		Uint32 height = readPackUint32( entry + 4 );
+		mSpriteOffsets[ i ] = readPackUint32( entry + 8 );
+		mSpriteWidths[ i ] = width;
+		mSpriteHeights[ i ] = height;
+
+		//Reject blobs running past the end of the file
+		Uint64 bytes = (Uint64)width * height * 4;
+		if( width == 0 || height == 0 || width > 0x4000 || height > 0x4000 || mSpriteOffsets[ i ] % ASSET_PACK_ALIGNMENT != 0 ||
+			mSpriteOffsets[ i ] > mSize || bytes > mSize - mSpriteOffsets[ i ] )
+		{
+			valid = false;
+		}
+	}
+
+	if( !valid )
+	{
+		printf( "Asset archive %s is truncated!\n", path.c_str() );
+		close();
+		return false;
+	}
+
+	//Art changed since packing, sources that aren't shipped leave the archive the only copy
+	for( int i = 0; i < NUM_OF_ASSET_SOURCES; ++i )
+	{
+		const Uint8* stamp = mData + 24 + NUM_OF_SPRITES * 12 + i * 12;
+		Uint32 size;
+		Uint64 modified;
+		if( statAssetSource( getAssetSourcePath( i ), size, modified ) &&
+			( size != readPackUint32( stamp ) || modified != ( readPackUint32( stamp + 4 ) | ( (Uint64)readPackUint32( stamp + 8 ) << 32 ) ) ) )
+		{
+			printf( "Asset archive %s is older than %s, run with --pack to rebuild it!\n", path.c_str(), getAssetSourcePath( i ) );
+			close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void LAssetPack::close()
+{
+#ifdef _WIN32
+	if( mData != NULL )
+	{
+		UnmapViewOfFile( mData );
+	}
+	if( mMapping != NULL )
+	{
+		CloseHandle( mMapping );
+		mMapping = NULL;
+	}
+	if( mFile != INVALID_HANDLE_VALUE )
+	{
+		CloseHandle( mFile );
+		mFile = INVALID_HANDLE_VALUE;
+	}
+#else
+	if( mData != NULL )
+	{
+		munmap( (void*)mData, mSize );
+	}
+#endif
+	mData = NULL;
+	mSize = 0;
+}
+
+bool LAssetPack::isOpen()
+{
+	return mData != NULL;
+}
+
+SDL_Surface* LAssetPack::createSurface( SpriteId sprite )
+{
+	if( mData == NULL )
+	{
+		return NULL;
+	}
+
+	//Surfaces never write to pixels they don't own, the mapping stays read-only
+	void* pixels = (void*)( mData + mSpriteOffsets[ sprite ] );
+	SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormatFrom( pixels, mSpriteWidths[ sprite ], mSpriteHeights[ sprite ], 32, mSpriteWidths[ sprite ] * 4, SDL_PIXELFORMAT_ARGB8888 );
+	if( surface == NULL )
+	{
+		printf( "Unable to wrap packed sprite %s! SDL Error: %s\n", SPRITE_PATHS[ sprite ], SDL_GetError() );
+	}
+	return surface;
+}
+
+TTF_Font* LAssetPack::openFont( int ptsize )
+{
+	if( mData == NULL || mFontSize == 0 )
+	{
+		return NULL;
+	}
+
+	SDL_RWops* rw = SDL_RWFromConstMem( mData + mFontOffset, mFontSize );
+	if( rw == NULL )
+	{
+		return NULL;
+	}
+
+	//The font reads glyphs from the mapping for as long as it stays open
+	return TTF_OpenFontRW( rw, 1, ptsize );
+}
+
+const SpriteId LAssetLoader::LOAD_ORDER[ NUM_OF_SPRITES ] = { SPRITE_COCKY, SPRITE_BACKGROUND, SPRITE_SHELF, SPRITE_LIGHTS, SPRITE_ROACH };
+
+LAssetLoader::LAssetLoader()
+{
+	//Initialize
+	SDL_AtomicSet( &mNextJob, 0 );
+	for( int i = 0; i < NUM_OF_SPRITES; ++i )
+	{
+		mSurfaces[ i ] = NULL;
+		SDL_AtomicSet( &mDecoded[ i ], 0 );
+		mUploaded[ i ] = false;
+	}
+	mDecodedSignal = NULL;
+	mLoadedCount = 0;
+	mFailed = false;
+}
+
+bool LAssetLoader::start()
+{
+	mDecodedSignal = SDL_CreateSemaphore( 0 );
+	if( mDecodedSignal == NULL )
+	{
+		printf( "Unable to create loader semaphore! SDL Error: %s\n", SDL_GetError() );
+		return false;
+	}
+
+	//One worker per core, no more than there are sprites
+	int numThreads = std::min( std::max( SDL_GetCPUCount(), 1 ), (int)NUM_OF_SPRITES );
+	for( int i = 0; i < numThreads; ++i )
+	{
+		SDL_Thread* thread = SDL_CreateThread( decode, "asset loader", this );
+		if( thread == NULL )
+		{
+			printf( "Unable to create loader thread! SDL Error: %s\n", SDL_GetError() );
+			break;
+		}
+		mThreads.push_back( thread );
+	}
+
+	//Without any worker the main thread does the decoding itself
+	if( mThreads.empty() )
+	{
+		decode( this );
+	}
+
+	return true;
+}
+
+int LAssetLoader::decode( void* data )
+{
+	LAssetLoader* loader = (LAssetLoader*)data;
+
+	for( int job = SDL_AtomicAdd( &loader->mNextJob, 1 ); job < NUM_OF_SPRITES; job = SDL_AtomicAdd( &loader->mNextJob, 1 ) )
+	{
+		SpriteId sprite = LOAD_ORDER[ job ];
+		TraceScope trace( SPRITE_PATHS[ sprite ] );
+
+		//Collision masks come from the same pixels the atlas gets
+		SDL_Surface* surface = decodeSprite( sprite );
+		if( surface != NULL && !buildCollisionMasks( sprite, surface ) )
+		{
+			SDL_FreeSurface( surface );
+			surface = NULL;
+		}
+
+		if( surface == NULL )
+		{
+			printf( "Failed to load sprite %s!\n", SPRITE_PATHS[ sprite ] );
+		}
+
+		//Publish the surface before the flag the main thread checks
+		loader->mSurfaces[ sprite ] = surface;
+		SDL_MemoryBarrierRelease();
+		SDL_AtomicSet( &loader->mDecoded[ sprite ], 1 );
+		SDL_SemPost( loader->mDecodedSignal );
+	}
+
+	return 0;
+}
+
+void LAssetLoader::pump()
+{
+	for( int i = 0; i < NUM_OF_SPRITES; ++i )
+	{
+		if( mUploaded[ i ] || SDL_AtomicGet( &mDecoded[ i ] ) == 0 )
+		{
+			continue;
+		}
+		SDL_MemoryBarrierAcquire();
+
+		TraceScope trace( "upload sprite" );
+
+		mUploaded[ i ] = true;
+		if( mSurfaces[ i ] == NULL || !gSpriteAtlas.add( (SpriteId)i, mSurfaces[ i ] ) )
+		{
+			mFailed = true;
+		}
+		else
+		{
+			++mLoadedCount;
+		}
+
+		if( mSurfaces[ i ] != NULL )
+		{
+			SDL_FreeSurface( mSurfaces[ i ] );
+			mSurfaces[ i ] = NULL;
+		}
+	}
+}
+
+bool LAssetLoader::waitFor( SpriteId sprite )
+{
+	pump();
+	while( !mUploaded[ sprite ] )
+	{
+		SDL_SemWait( mDecodedSignal );
+		pump();
+	}
+
+	return gSpriteAtlas.isLoaded( sprite );
+}
+
+int LAssetLoader::getLoadedCount()
+{
+	return mLoadedCount;
+}
+
+bool LAssetLoader::isDone()
+{
+	return mLoadedCount == NUM_OF_SPRITES;
+}
+
+bool LAssetLoader::hasFailed()
+{
+	return mFailed;
+}
+
+void LAssetLoader::stop()
+{
+	for( size_t i = 0; i < mThreads.size(); ++i )
+	{
+		SDL_WaitThread( mThreads[ i ], NULL );
+	}
+	mThreads.clear();
+
+	for( int i = 0; i < NUM_OF_SPRITES; ++i )
+	{
+		if( mSurfaces[ i ] != NULL )
+		{
+			SDL_FreeSurface( mSurfaces[ i ] );
+			mSurfaces[ i ] = NULL;
+		}
+	}
+
+	if( mDecodedSignal != NULL )
+	{
+		SDL_DestroySemaphore( mDecodedSignal );
+		mDecodedSignal = NULL;
+	}
+}
+
+//Score history files are little-endian. The snapshot is "CRSH", version,
+//generation, number of scores, then per score the score and its runs. The log
+//is "CRSL", version, the generation of the snapshot it adds to, then one word
+//per run. Logs of an older generation are already in the snapshot
+const char SCORE_HISTORY_MAGIC[ 4 ] = { 'C', 'R', 'S', 'H' };
+const char SCORE_LOG_MAGIC[ 4 ] = { 'C', 'R', 'S', 'L' };
+const Uint32 SCORE_HISTORY_VERSION = 1;
+
+//Runs logged before the log is folded into a new snapshot
+const Uint32 SCORE_LOG_COMPACT_AFTER = 1 << 16;
+
+//Highest score the index takes, about 87 minutes of play at 50 points a second.
+//The index is dense over scores, this keeps it at a few megabytes. Longer games
+//are counted at the cap, anything above it on disk is a damaged file
+const Uint32 MAX_INDEXED_SCORE = 1 << 18;
+
+ScoreIndex::ScoreIndex()
+{
+    mTotal = 0;
+    mBest = 0;
+}
+
+void ScoreIndex::add(Uint32 score, Uint32 count)
+{
+    if (score >= mCounts.size())
+    {
+        grow(score);
+    }
+
+    mCounts[score] += count;
+    for (size_t i = score + 1; i < mTree.size(); i += i & (~i + 1))
+    {
+        mTree[i] += count;
+    }
+
+    mTotal += count;
+    mBest = std::max(mBest, score);
+}
+
+Uint32 ScoreIndex::getTotal()
+{
+    return mTotal;
+}
+
+Uint32 ScoreIndex::getBest()
+{
+    return mBest;
+}
+
+Uint32 ScoreIndex::countBelow(Uint32 score)
+{
+    Uint32 count = 0;
+    for (size_t i = std::min((size_t)score, mCounts.size()); i > 0; i -= i & (~i + 1))
+    {
+        count += mTree[i];
+    }
+    return count;
+}
+
+Uint32 ScoreIndex::countAbove(Uint32 score)
+{
+    Uint32 tied = score < mCounts.size() ? mCounts[score] : 0;
+    return mTotal - countBelow(score) - tied;
+}
+
+void ScoreIndex::getHistogram(std::vector<Uint32>& scores, std::vector<Uint32>& counts)
+{
+    scores.clear();
+    counts.clear();
+    for (size_t i = 0; i < mCounts.size(); ++i)
+    {
+        if (mCounts[i] != 0)
+        {
+            scores.push_back(i);
+            counts.push_back(mCounts[i]);
+        }
+    }
+}
+
+void ScoreIndex::grow(Uint32 score)
+{
+    size_t size = std::max(mCounts.size(), (size_t)1024);
+    while (size <= score)
+    {
+        size *= 2;
+    }
+    mCounts.resize(size, 0);
+
+    //Rebuild the tree in linear time, each node passing its sum on to its parent
+    mTree.assign(size + 1, 0);
+    for (size_t i = 1; i <= size; ++i)
+    {
+        mTree[i] += mCounts[i - 1];
+        size_t parent = i + (i & (~i + 1));
+        if (parent <= size)
+        {
+            mTree[parent] += mTree[i];
+        }
+    }
+}
+
+LScoreHistory::LScoreHistory()
+{
+	//Initialize
+	mGeneration = 0;
+	mLogValid = false;
+	mLogCount = 0;
+	mNeedsCompaction = false;
+	mPendingLock = NULL;
+	SDL_AtomicSet( &mQuit, 0 );
+	mWriteSignal = NULL;
+	mThread = NULL;
+}
+
+void LScoreHistory::load( std::string historyPath, std::string logPath, std::string legacyPath )
+{
+	TraceScope trace( "read score history" );
+
+	mHistoryPath = historyPath;
+	mLogPath = logPath;
+
+	bool hasHistory = readHistory();
+	bool hasLog = readLog( hasHistory );
+
+	//The writer starts from what is on disk
+	mSaved = mIndex;
+
+	//The single high score the game used to keep becomes the first run
+	if( !hasHistory && !hasLog )
+	{
+		std::ifstream legacy( legacyPath.c_str() );
+		std::string saved;
+		int score = legacy >> saved ? atoi( saved.c_str() ) : 0;
+		if( score > 0 && (Uint32)score <= MAX_INDEXED_SCORE )
+		{
+			mIndex.add( score, 1 );
+			mPending.push_back( score );
+		}
+	}
+
+	mPendingLock = SDL_CreateMutex();
+	mWriteSignal = SDL_CreateSemaphore( 0 );
+	if( mPendingLock != NULL && mWriteSignal != NULL )
+	{
+		mThread = SDL_CreateThread( write, "score history writer", this );
+	}
+
+	//Without a writer the main thread saves itself
+	if( mThread == NULL )
+	{
+		printf( "Unable to start score history writer, saving in place! SDL Error: %s\n", SDL_GetError() );
+		flush();
+	}
+	else if( !mPending.empty() || mNeedsCompaction )
+	{
+		SDL_SemPost( mWriteSignal );
+	}
+}
+
+Uint32 LScoreHistory::getBest()
+{
+	return mIndex.getBest();
+}
+
+Uint32 LScoreHistory::getCount()
+{
+	return mIndex.getTotal();
+}
+
+Uint32 LScoreHistory::getRank( Uint32 score )
+{
+	return mIndex.countAbove( score ) + 1;
+}
+
+double LScoreHistory::getPercentile( Uint32 score )
+{
+	if( mIndex.getTotal() == 0 )
+	{
+		return 0.0;
+	}
+	return 100.0 * mIndex.countBelow( score ) / mIndex.getTotal();
+}
+
+bool LScoreHistory::submit( Uint32 score )
+{
+	score = std::min( score, MAX_INDEXED_SCORE );
+	bool isBest = mIndex.getTotal() == 0 || score > mIndex.getBest();
+	mIndex.add( score, 1 );
+
+	if( mThread == NULL )
+	{
+		mPending.push_back( score );
+		flush();
+	}
+	else
+	{
+		SDL_LockMutex( mPendingLock );
+		mPending.push_back( score );
+		SDL_UnlockMutex( mPendingLock );
+		SDL_SemPost( mWriteSignal );
+	}
+	return isBest;
+}
+
+void LScoreHistory::stop()
+{
+	if( mThread != NULL )
+	{
+		SDL_AtomicSet( &mQuit, 1 );
+		SDL_SemPost( mWriteSignal );
+		SDL_WaitThread( mThread, NULL );
+		mThread = NULL;
+	}
+
+	if( mWriteSignal != NULL )
+	{
+		SDL_DestroySemaphore( mWriteSignal );
+		mWriteSignal = NULL;
+	}
+
+	if( mPendingLock != NULL )
+	{
+		SDL_DestroyMutex( mPendingLock );
+		mPendingLock = NULL;
+	}
+}
+
+int LScoreHistory::write( void* data )
+{
+	LScoreHistory* history = (LScoreHistory*)data;
+
+	while( true )
+	{
+		SDL_SemWait( history->mWriteSignal );
+		bool quit = SDL_AtomicGet( &history->mQuit ) != 0;
+
+		history->flush();
+
+		if( quit )
+		{
+			return 0;
+		}
+	}
+}
+
+void LScoreHistory::flush()
+{
+	//Take everything submitted so far in one go, the main thread only waits for the swap
+	SDL_LockMutex( mPendingLock );
+	mWriting.swap( mPending );
+	SDL_UnlockMutex( mPendingLock );
+
+	if( !mWriting.empty() )
+	{
+		for( size_t i = 0; i < mWriting.size(); ++i )
+		{
+			mSaved.add( mWriting[ i ], 1 );
+		}
+
+		//Scores that didn't make it into the log go into the next snapshot
+		if( !append( mWriting ) )
+		{
+			mNeedsCompaction = true;
+		}
+		mWriting.clear();
+	}
+
+	if( ( mNeedsCompaction || mLogCount >= SCORE_LOG_COMPACT_AFTER ) && compact() )
+	{
+		mNeedsCompaction = false;
+	}
+}
+
+bool LScoreHistory::append( const std::vector<Uint32>& scores )
+{
+	TraceScope trace( "append scores.log" );
+
+	//The log was left to a snapshot it doesn't belong to
+	if( mLogPath.empty() )
+	{
+		return false;
+	}
+
+	if( !mLogValid )
+	{
+		std::vector<Uint8> header( SCORE_LOG_MAGIC, SCORE_LOG_MAGIC + 4 );
+		writeUint32( header, SCORE_HISTORY_VERSION );
+		writeUint32( header, mGeneration );
+		if( !replaceFile( mLogPath, header ) )
+		{
+			return false;
+		}
+		mLogValid = true;
+		mLogCount = 0;
+	}
+
+	std::vector<Uint8> data;
+	for( size_t i = 0; i < scores.size(); ++i )
+	{
+		writeUint32( data, scores[ i ] );
+	}
+
+	FILE* file = fopen( mLogPath.c_str(), "ab" );
+	if( file == NULL )
+	{
+		printf( "Unable to append to %s!\n", mLogPath.c_str() );
+		return false;
+	}
+
+	bool written = fwrite( &data[ 0 ], 1, data.size(), file ) == data.size() && syncFile( file );
+	written = fclose( file ) == 0 && written;
+	if( !written )
+	{
+		//A torn record would misalign everything after it, start over from a snapshot
+		printf( "Unable to append to %s!\n", mLogPath.c_str() );
+		mLogValid = false;
+		return false;
+	}
+
+	mLogCount += scores.size();
+	return true;
+}
+
+bool LScoreHistory::compact()
+{
+	TraceScope trace( "compact score history" );
+
+	std::vector<Uint32> scores;
+	std::vector<Uint32> counts;
+	mSaved.getHistogram( scores, counts );
+
+	std::vector<Uint8> data( SCORE_HISTORY_MAGIC, SCORE_HISTORY_MAGIC + 4 );
+	writeUint32( data, SCORE_HISTORY_VERSION );
+	writeUint32( data, mGeneration + 1 );
+	writeUint32( data, scores.size() );
+	for( size_t i = 0; i < scores.size(); ++i )
+	{
+		writeUint32( data, scores[ i ] );
+		writeUint32( data, counts[ i ] );
+	}
+
+	//Once the snapshot is in place the log is a generation behind and no longer read
+	if( !replaceFile( mHistoryPath, data ) )
+	{
+		return false;
+	}
+	++mGeneration;
+	mLogValid = false;
+	mLogCount = 0;
+	if( !mLogPath.empty() )
+	{
+		remove( mLogPath.c_str() );
+	}
+
+	return true;
+}
+
+bool LScoreHistory::readHistory()
+{
+	std::vector<Uint8> data;
+	if( !readFile( mHistoryPath, data ) )
+	{
+		return false;
+	}
+
+	size_t pos = 4;
+	Uint32 version;
+	Uint32 generation;
+	Uint32 count;
+	if( data.size() < pos || memcmp( &data[ 0 ], SCORE_HISTORY_MAGIC, 4 ) != 0 || !readUint32( data, pos, version ) ||
+		version != SCORE_HISTORY_VERSION || !readUint32( data, pos, generation ) || !readUint32( data, pos, count ) )
+	{
+		printf( "%s is not a score history!\n", mHistoryPath.c_str() );
+		return false;
+	}
+
+	//Nothing is taken from a damaged snapshot
+	ScoreIndex index;
+	for( Uint32 i = 0; i < count; ++i )
+	{
+		Uint32 score;
+		Uint32 runs;
+		if( !readUint32( data, pos, score ) || !readUint32( data, pos, runs ) || score > MAX_INDEXED_SCORE )
+		{
+			printf( "Score history %s is damaged!\n", mHistoryPath.c_str() );
+			return false;
+		}
+		index.add( score, runs );
+	}
+
+	mIndex = index;
+	mGeneration = generation;
+	return true;
+}
+
+bool LScoreHistory::readLog( bool hasHistory )
+{
+	std::vector<Uint8> data;
+	if( !readFile( mLogPath, data ) )
+	{
+		return false;
+	}
+
+	size_t pos = 4;
+	Uint32 version;
+	Uint32 generation;
+	if( data.size() < pos || memcmp( &data[ 0 ], SCORE_LOG_MAGIC, 4 ) != 0 || !readUint32( data, pos, version ) ||
+		version != SCORE_HISTORY_VERSION || !readUint32( data, pos, generation ) )
+	{
+		printf( "%s is not a score log!\n", mLogPath.c_str() );
+		return false;
+	}
+
+	//With the snapshot lost the log holds the only runs left, carry on from its generation
+	if( !hasHistory )
+	{
+		mGeneration = generation;
+	}
+	//Usually left behind by a compaction that finished, its runs are in the snapshot. It could
+	//also be the newer of the two, so it is kept to one side rather than started over
+	else if( generation != mGeneration )
+	{
+		char suffix[ 16 ];
+		sprintf( suffix, ".%u", generation );
+		std::string kept = mLogPath + suffix;
+		if( rename( mLogPath.c_str(), kept.c_str() ) == 0 )
+		{
+			printf( "Score log %s is of another snapshot, kept as %s\n", mLogPath.c_str(), kept.c_str() );
+		}
+		else
+		{
+			//Without a log the scores go straight into snapshots
+			printf( "Score log %s is of another snapshot and can't be moved aside, leaving it be!\n", mLogPath.c_str() );
+			mLogPath.clear();
+		}
+		return false;
+	}
+
+	Uint32 score;
+	while( readUint32( data, pos, score ) )
+	{
+		if( score <= MAX_INDEXED_SCORE )
+		{
+			mIndex.add( score, 1 );
+		}
+		++mLogCount;
+	}
+	mLogValid = true;
+
+	//A crash mid-append leaves part of a record, fold what is whole into a snapshot
+	if( pos != data.size() )
+	{
+		mLogValid = false;
+		mNeedsCompaction = true;
+	}
+
+	return true;
+}
+
+bool readFile( std::string path, std::vector<Uint8>& data )
+{
+	std::ifstream file( path.c_str(), std::ios::in | std::ios::binary );
+	if( !file.good() )
+	{
+		return false;
+	}
+
+	data.assign( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+	return true;
+}
+
+bool syncFile( FILE* file )
+{
+	if( fflush( file ) != 0 )
+	{
+		return false;
+	}
+#ifdef _WIN32
+	return _commit( _fileno( file ) ) == 0;
+#else
+	return fsync( fileno( file ) ) == 0;
+#endif
+}
+
+bool replaceFile( std::string path, const std::vector<Uint8>& data )
+{
+	std::string temp = path + ".tmp";
+	FILE* file = fopen( temp.c_str(), "wb" );
+	if( file == NULL )
+	{
+		printf( "Unable to write %s!\n", temp.c_str() );
+		return false;
+	}
+
+	//The new contents must be on disk before they replace the old
+	bool written = fwrite( &data[ 0 ], 1, data.size(), file ) == data.size() && syncFile( file );
+	written = fclose( file ) == 0 && written;
+
+	//Replacing is atomic, a crash leaves either the old file or the new one
+#ifdef _WIN32
+	written = written && MoveFileExA( temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH );
+#else
+	written = written && rename( temp.c_str(), path.c_str() ) == 0;
+#endif
+
+	if( !written )
+	{
+		printf( "Unable to replace %s!\n", path.c_str() );
+		remove( temp.c_str() );
+	}
+	return written;
+}
+
+LTextAtlas::LTextAtlas()
+{
+	//Initialize
+	mHeight = 0;
+
+	for( int i = 0; i < NUM_OF_GLYPHS; ++i )
+	{
+		mGlyphClips[ i ].x = 0;
+		mGlyphClips[ i ].y = 0;
+		mGlyphClips[ i ].w = 0;
+		mGlyphClips[ i ].h = 0;
+		mGlyphAdvances[ i ] = 0;
+	}
+
+	//Quad indices never change, only the vertices do
+	for( int quad = 0; quad < MAX_BATCH_GLYPHS; ++quad )
+	{
+		mIndices[ quad * 6 + 0 ] = quad * 4 + 0;
+		mIndices[ quad * 6 + 1 ] = quad * 4 + 1;
+		mIndices[ quad * 6 + 2 ] = quad * 4 + 2;
+		mIndices[ quad * 6 + 3 ] = quad * 4 + 0;
+		mIndices[ quad * 6 + 4 ] = quad * 4 + 2;
+		mIndices[ quad * 6 + 5 ] = quad * 4 + 3;
+	}
+}
+
+bool LTextAtlas::loadFromFont( TTF_Font* font )
+{
+	//Get rid of preexisting atlas
+	free();
+
+	SDL_Color white = { 0xFF, 0xFF, 0xFF, 0xFF };
+	SDL_Surface* glyphSurfaces[ NUM_OF_GLYPHS ];
+
+	//Rasterize each glyph once and shelf-pack it into rows
+	int penX = 0;
+	int penY = 0;
+	int rowHeight = 0;
+
+	for( int i = 0; i < NUM_OF_GLYPHS; ++i )
+	{
+		Uint16 ch = FIRST_GLYPH + i;
+
+		if( TTF_GlyphMetrics( font, ch, NULL, NULL, NULL, NULL, &mGlyphAdvances[ i ] ) == -1 )
+		{
+			mGlyphAdvances[ i ] = 0;
+		}
+
+		//Blank glyphs like space have no surface, only an advance
+		glyphSurfaces[ i ] = TTF_RenderGlyph_Blended( font, ch, white );
+		if( glyphSurfaces[ i ] == NULL )
+		{
+			continue;
+		}
+
+		if( penX + glyphSurfaces[ i ]->w > ATLAS_WIDTH )
+		{
+			penX = 0;
+			penY += rowHeight + 1;
+			rowHeight = 0;
+		}
+
+		mGlyphClips[ i ].x = penX;
+		mGlyphClips[ i ].y = penY;
+		mGlyphClips[ i ].w = glyphSurfaces[ i ]->w;
+		mGlyphClips[ i ].h = glyphSurfaces[ i ]->h;
+
+		penX += glyphSurfaces[ i ]->w + 1;
+		if( glyphSurfaces[ i ]->h > rowHeight )
+		{
+			rowHeight = glyphSurfaces[ i ]->h;
+		}
+	}
+
+	//Copy the glyphs into a single transparent surface
+	SDL_Surface* atlasSurface = SDL_CreateRGBSurfaceWithFormat( 0, ATLAS_WIDTH, penY + rowHeight, 32, SDL_PIXELFORMAT_ARGB8888 );
+	if( atlasSurface == NULL )
+	{
+		printf( "Unable to create glyph atlas surface! SDL Error: %s\n", SDL_GetError() );
+	}
+	else
+	{
+		SDL_FillRect( atlasSurface, NULL, SDL_MapRGBA( atlasSurface->format, 0xFF, 0xFF, 0xFF, 0 ) );
+
+		for( int i = 0; i < NUM_OF_GLYPHS; ++i )
+		{
+			if( glyphSurfaces[ i ] != NULL )
+			{
+				//Keep the glyph's own alpha instead of blending it away
+				SDL_SetSurfaceBlendMode( glyphSurfaces[ i ], SDL_BLENDMODE_NONE );
+				SDL_BlitSurface( glyphSurfaces[ i ], NULL, atlasSurface, &mGlyphClips[ i ] );
+			}
+		}
+
+		//Upload the atlas, the only texture text ever needs
+		if( !mTexture.loadFromSurface( atlasSurface ) )
+		{
+			printf( "Unable to create glyph atlas texture!\n" );
+		}
+
+		SDL_FreeSurface( atlasSurface );
+	}
+
+	for( int i = 0; i < NUM_OF_GLYPHS; ++i )
+	{
+		if( glyphSurfaces[ i ] != NULL )
+		{
+			SDL_FreeSurface( glyphSurfaces[ i ] );
+		}
+	}
+
+	mHeight = TTF_FontHeight( font );
+
+	return mTexture.getWidth() > 0;
+}
+
+void LTextAtlas::free()
+{
+	mTexture.free();
+	mHeight = 0;
+}
+
+int LTextAtlas::glyphIndex( char c )
+{
+	int glyph = (unsigned char)c;
+
+	//Fall back to '?' for anything outside the atlas
+	if( glyph < FIRST_GLYPH || glyph > LAST_GLYPH )
+	{
+		glyph = '?';
+	}
+
+	return glyph - FIRST_GLYPH;
+}
+
+void LTextAtlas::render( int x, int y, const char* text, SDL_Color textColor, float scale )
+{
+	float atlasWidth = (float)mTexture.getWidth();
+	float atlasHeight = (float)mTexture.getHeight();
+
+	float penX = (float)x;
+	int numGlyphs = 0;
+
+	for( const char* c = text; *c != '\0'; ++c )
+	{
+		int glyph = glyphIndex( *c );
+		const SDL_Rect& clip = mGlyphClips[ glyph ];
+
+		if( clip.w > 0 )
+		{
+			//Flush a full batch
+			if( numGlyphs == MAX_BATCH_GLYPHS )
+			{
+				mTexture.renderGeometry( mVertices, numGlyphs * 4, mIndices, numGlyphs * 6 );
+				numGlyphs = 0;
+			}
+
+			float left = penX;
+			float top = (float)y;
+			float right = left + clip.w * scale;
+			float bottom = top + clip.h * scale;
+
+			float u0 = clip.x / atlasWidth;
+			float v0 = clip.y / atlasHeight;
+			float u1 = ( clip.x + clip.w ) / atlasWidth;
+			float v1 = ( clip.y + clip.h ) / atlasHeight;
+
+			SDL_Vertex* quad = &mVertices[ numGlyphs * 4 ];
+
+			quad[ 0 ].position.x = left;  quad[ 0 ].position.y = top;    quad[ 0 ].tex_coord.x = u0; quad[ 0 ].tex_coord.y = v0;
+			quad[ 1 ].position.x = right; quad[ 1 ].position.y = top;    quad[ 1 ].tex_coord.x = u1; quad[ 1 ].tex_coord.y = v0;
+			quad[ 2 ].position.x = right; quad[ 2 ].position.y = bottom; quad[ 2 ].tex_coord.x = u1; quad[ 2 ].tex_coord.y = v1;
+			quad[ 3 ].position.x = left;  quad[ 3 ].position.y = bottom; quad[ 3 ].tex_coord.x = u0; quad[ 3 ].tex_coord.y = v1;
+
+			for( int v = 0; v < 4; ++v )
+			{
+				quad[ v ].color = textColor;
+			}
+
+			++numGlyphs;
+		}
+
+		penX += mGlyphAdvances[ glyph ] * scale;
+	}
+
+	//Render remaining glyphs
+	if( numGlyphs > 0 )
+	{
+		mTexture.renderGeometry( mVertices, numGlyphs * 4, mIndices, numGlyphs * 6 );
+	}
+}
+
+int LTextAtlas::getTextWidth( const char* text )
+{
+	int width = 0;
+
+	for( const char* c = text; *c != '\0'; ++c )
+	{
+		width += mGlyphAdvances[ glyphIndex( *c ) ];
+	}
+
+	return width;
+}
+
+int LTextAtlas::getHeight()
+{
+	return mHeight;
+}
+
+Profiler::Profiler()
+{
+	mEnabled = false;
+	setEnabled( false );
+}
+
+void Profiler::setEnabled( bool enabled )
+{
+	mEnabled = enabled;
+
+	//Start a fresh window of samples
+	for( int phase = 0; phase < NUM_OF_PHASES; ++phase )
+	{
+		mCurrent[ phase ] = 0;
+		mSums[ phase ] = 0.0;
+	}
+	mFrameSum = 0.0;
+	mNext = 0;
+	mCount = 0;
+}
+
+bool Profiler::isEnabled()
+{
+	return mEnabled;
+}
+
+void Profiler::add( ProfilePhase phase, Uint64 elapsed )
+{
+	mCurrent[ phase ] += elapsed;
+}
+
+void Profiler::endFrame( Uint64 frameTime )
+{
+	if( !mEnabled )
+	{
+		return;
+	}
+
+	double toMs = 1000.0 / SDL_GetPerformanceFrequency();
+
+	//Drop the oldest frame from the running sums once the ring is full
+	if( mCount == HISTORY )
+	{
+		for( int phase = 0; phase < NUM_OF_PHASES; ++phase )
+		{
+			mSums[ phase ] -= mHistory[ mNext ][ phase ];
+		}
+		mFrameSum -= mFrameHistory[ mNext ];
+	}
+	else
+	{
+		++mCount;
+	}
+
+	for( int phase = 0; phase < NUM_OF_PHASES; ++phase )
+	{
+		mHistory[ mNext ][ phase ] = (float)( mCurrent[ phase ] * toMs );
+		mSums[ phase ] += mHistory[ mNext ][ phase ];
+		mCurrent[ phase ] = 0;
+	}
+	mFrameHistory[ mNext ] = (float)( frameTime * toMs );
+	mFrameSum += mFrameHistory[ mNext ];
+
+	mNext = ( mNext + 1 ) % HISTORY;
+}
+
+double Profiler::getAverage( ProfilePhase phase )
+{
+	return mCount > 0 ? mSums[ phase ] / mCount : 0.0;
+}
+
+double Profiler::getFrameAverage()
+{
+	return mCount > 0 ? mFrameSum / mCount : 0.0;
+}
+
+void Profiler::render()
+{
+	const int PANEL_WIDTH = 220;
+	const int LINE_HEIGHT = 15;
+	const int GRAPH_HEIGHT = 60;
+	const float TEXT_SCALE = 0.5f;
+
+	//Graph height, two 60Hz frames so misses still fit
+	const float GRAPH_MS = 33.3f;
+
+	int panelX = SCREEN_WIDTH - PANEL_WIDTH - 10;
+	int panelY = 10;
+
+	SDL_Color textColor = { 0xFF, 0xFF, 0xFF, 0xFF };
+	char line[ 40 ];
+
+	//Darken the panel
+	SDL_Rect panel = { panelX, panelY, PANEL_WIDTH, LINE_HEIGHT * ( NUM_OF_PHASES + 2 ) + GRAPH_HEIGHT + 15 };
+	SDL_SetRenderDrawBlendMode( gRenderer, SDL_BLENDMODE_BLEND );
+	SDL_SetRenderDrawColor( gRenderer, 0, 0, 0, 0xB0 );
+	SDL_RenderFillRect( gRenderer, &panel );
+
+	//Rolling averages
+	double frameMs = getFrameAverage();
+	sprintf( line, "frame %.2f ms (%.0f fps)", frameMs, frameMs > 0.0 ? 1000.0 / frameMs : 0.0 );
+	gTextAtlas.render( panelX + 5, panelY + 5, line, textColor, TEXT_SCALE );
+
+	for( int phase = 0; phase < NUM_OF_PHASES; ++phase )
+	{
+		int y = panelY + 5 + LINE_HEIGHT * ( phase + 1 );
+		gTextAtlas.render( panelX + 5, y, PHASE_NAMES[ phase ], textColor, TEXT_SCALE );
+
+		sprintf( line, "%.3f ms", getAverage( (ProfilePhase)phase ) );
+		gTextAtlas.render( panelX + PANEL_WIDTH - 5 - (int)( gTextAtlas.getTextWidth( line ) * TEXT_SCALE ), y, line, textColor, TEXT_SCALE );
+	}
+
+	//Renderer work of the last frame
+	const RenderStats& stats = LTexture::getFrameStats();
+	sprintf( line, "%u draws, %u new textures", stats.drawCalls, stats.textureCreations );
+	gTextAtlas.render( panelX + 5, panelY + 5 + LINE_HEIGHT * ( NUM_OF_PHASES + 1 ), line, textColor, TEXT_SCALE );
+
+	//Frame-time graph, oldest frame on the left
+	int graphX = panelX + ( PANEL_WIDTH - HISTORY ) / 2;
+	int graphBottom = panel.y + panel.h - 5;
+
+	for( int i = 0; i < mCount; ++i )
+	{
+		float ms = mFrameHistory[ ( mNext - mCount + i + HISTORY ) % HISTORY ];
+		int height = (int)( ms / GRAPH_MS * GRAPH_HEIGHT );
+		if( height > GRAPH_HEIGHT )
+		{
+			height = GRAPH_HEIGHT;
+		}
+
+		mBars[ i ].x = graphX + i;
+		mBars[ i ].y = graphBottom - height;
+		mBars[ i ].w = 1;
+		mBars[ i ].h = height;
+	}
+	SDL_SetRenderDrawColor( gRenderer, 0x40, 0xE0, 0x40, 0xFF );
+	SDL_RenderFillRects( gRenderer, mBars, mCount );
+
+	//16.7ms line
+	int targetY = graphBottom - (int)( 1000.0f / 60.0f / GRAPH_MS * GRAPH_HEIGHT );
+	SDL_SetRenderDrawColor( gRenderer, 0xE0, 0x40, 0x40, 0xFF );
+	SDL_RenderDrawLine( gRenderer, graphX, targetY, graphX + HISTORY, targetY );
+
+	SDL_SetRenderDrawBlendMode( gRenderer, SDL_BLENDMODE_NONE );
+}
+
+ScopedTimer::ScopedTimer( ProfilePhase phase, Uint64* totals )
+{
+	mPhase = phase;
+	mTotals = totals;
+
+	//Skip the counter read entirely while profiling is off
+	mStart = mTotals != NULL || gProfiler.isEnabled() ? SDL_GetPerformanceCounter() : 0;
+
+	gTrace.begin( PHASE_NAMES[ phase ] );
+}
+
+ScopedTimer::~ScopedTimer()
+{
+	if( mTotals != NULL )
+	{
+		mTotals[ mPhase ] += SDL_GetPerformanceCounter() - mStart;
+	}
+	else if( mStart != 0 )
+	{
+		gProfiler.add( mPhase, SDL_GetPerformanceCounter() - mStart );
+	}
+
+	gTrace.end( PHASE_NAMES[ mPhase ] );
+}
+
+TraceBuffer::TraceBuffer()
+{
+	//Initialize
+	mEvents = NULL;
+	mCapacity = 0;
+	SDL_AtomicSet( &mNext, 0 );
+	SDL_AtomicSet( &mDropped, 0 );
+	mStart = 0;
+}
+
+TraceBuffer::~TraceBuffer()
+{
+	//Deallocate
+	delete[] mEvents;
+}
+
+bool TraceBuffer::start( int capacity )
+{
+	delete[] mEvents;
+
+	//All memory up front, recording never allocates. Failing to get it is returned, not thrown
+	mEvents = new( std::nothrow ) TraceEvent[ capacity ];
+	mCapacity = mEvents != NULL ? capacity : 0;
+	SDL_AtomicSet( &mNext, 0 );
+	SDL_AtomicSet( &mDropped, 0 );
+	mStart = SDL_GetPerformanceCounter();
+
+	return mEvents != NULL;
+}
+
+bool TraceBuffer::isActive()
+{
+	return mEvents != NULL;
+}
+
+void TraceBuffer::begin( const char* name )
+{
+	if( mEvents != NULL )
+	{
+		record( name, 'B' );
+	}
+}
+
+void TraceBuffer::end( const char* name )
+{
+	if( mEvents != NULL )
+	{
+		record( name, 'E' );
+	}
+}
+
+void TraceBuffer::record( const char* name, char phase )
+{
+	//Claim a slot, threads never share one. The count stops at the capacity,
+	//long runs would otherwise wrap it negative
+	int slot;
+	do
+	{
+		slot = SDL_AtomicGet( &mNext );
+		if( slot >= mCapacity )
+		{
+			SDL_AtomicAdd( &mDropped, 1 );
+			return;
+		}
+	}
+	while( !SDL_AtomicCAS( &mNext, slot, slot + 1 ) );
+
+	TraceEvent& event = mEvents[ slot ];
+	event.name = name;
+	event.phase = phase;
+	event.thread = SDL_ThreadID();
+	event.timestamp = SDL_GetPerformanceCounter();
+}
+
+bool TraceBuffer::write( std::string path )
+{
+	if( mEvents == NULL )
+	{
+		return false;
+	}
+
+	FILE* file = fopen( path.c_str(), "w" );
+	if( file == NULL )
+	{
+		printf( "Unable to write trace %s!\n", path.c_str() );
+		return false;
+	}
+
+	int count = SDL_AtomicGet( &mNext );
+	if( count > mCapacity )
+	{
+		count = mCapacity;
+	}
+
+	//Trace timestamps are microseconds
+	double toUs = 1000000.0 / SDL_GetPerformanceFrequency();
+
+	fprintf( file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+	for( int i = 0; i < count; ++i )
+	{
+		const TraceEvent& event = mEvents[ i ];
+		fprintf( file, "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%lu}%s\n",
+				 event.name, event.phase, ( event.timestamp - mStart ) * toUs, event.thread, i + 1 < count ? "," : "" );
+	}
+	fprintf( file, "]}\n" );
+	fclose( file );
+
+	printf( "Wrote %d trace events to %s", count, path.c_str() );
+	if( SDL_AtomicGet( &mDropped ) > 0 )
+	{
+		printf( ", %d dropped after the buffer filled", SDL_AtomicGet( &mDropped ) );
+	}
+	printf( "\n" );
+
+	return true;
+}
+
+TraceScope::TraceScope( const char* name )
+{
+	mName = name;
+	gTrace.begin( name );
+}
+
+TraceScope::~TraceScope()
+{
+	gTrace.end( mName );
+}
+
+Random::Random( Uint32 seed )
+{
+	this->seed( seed );
+}
+
+void Random::seed( Uint32 seed )
+{
+	//Scramble the seed so nearby seeds give unrelated sequences, xorshift can't start at 0
+	mState = seed * 2654435761u ^ 0x9E3779B9u;
+	if( mState == 0 )
+	{
+		mState = 1;
+	}
+}
+
+Uint32 Random::next()
+{
+	//xorshift32
+	mState ^= mState << 13;
+	mState ^= mState >> 17;
+	mState ^= mState << 5;
+	return mState;
+}
+
+int Random::range( int n )
+{
+	return next() % n;
+}
+
+//Per kind data, in EntityKind order
+const EntityKindInfo ENTITY_KINDS[ NUM_OF_ENTITY_KINDS ] =
+{
+    { SPRITE_ROACH, SDL_FLIP_NONE, 0.0f, 1.0f, FALL_ACCELERATION, (int)GRAVITY },
+    { SPRITE_SHELF, SDL_FLIP_NONE, -1.0f, 0.0f, OBSTACLE_ACCELERATION, OBSTACLE_SPEED },
+    { SPRITE_LIGHTS, SDL_FLIP_VERTICAL, -1.0f, 0.0f, OBSTACLE_ACCELERATION, OBSTACLE_SPEED }
+};
+
+void EntityPool::resize(int capacity)
+{
+    posX.assign(capacity, 0.0f);
+    posY.assign(capacity, 0.0f);
+    prevX.assign(capacity, 0.0f);
+    prevY.assign(capacity, 0.0f);
+    rVel = 0.0f;
+    vel = 0;
+    head = 0;
+    count = 0;
+}
+
+int EntityPool::capacity()
+{
+    return (int)posX.size();
+}
+
+int EntityPool::slot(int k)
+{
+    int i = head + k;
+    return i >= capacity() ? i - capacity() : i;
+}
+
+int EntityPool::push()
+{
+    int i = slot(count);
+    ++count;
+    return i;
+}
+
+void EntityPool::pop()
+{
+    head = slot(1);
+    --count;
+}
+
+//Horizontal extent of a kind's opaque pixels, relative to its position
+void kindSpan(int kind, int &minX, int &maxX)
+{
+    const SDL_Rect &bounds = gEntityMasks[kind].getBounds();
+
+    minX = bounds.x;
+    maxX = bounds.x + bounds.w;
+}
+
+void ObstacleGenerator::reset(Uint32 seed, const ObstacleSettings &settings)
+{
+    mRng.seed(seed);
+    mSettings = settings;
+}
+
+void ObstacleGenerator::generate(EntityPool &shelves, EntityPool &lights)
+{
+    while (shelves.count < shelves.capacity() && lights.count < lights.capacity())
+    {
+        //Gaps vary between half and one and a half times the spacing
+        float x;
+        if (shelves.count == 0)
+        {
+            x = SCREEN_WIDTH - mRng.range(20);
+        }
+        else
+        {
+            float newest = shelves.posX[shelves.slot(shelves.count - 1)];
+            if (newest >= SCREEN_WIDTH + GENERATE_AHEAD)
+            {
+                break;
+            }
+            x = newest + SHELF_WIDTH + mSettings.spacing / 2 + mRng.range(mSettings.spacing + 1);
+        }
+
+        //Slots keep the velocity the whole ring has been accelerating with
+        int shelf = shelves.push();
+        shelves.posX[shelf] = x;
+        shelves.posY[shelf] = randomShelfY(mRng);
+        shelves.prevX[shelf] = shelves.posX[shelf];
+        shelves.prevY[shelf] = shelves.posY[shelf];
+
+        if (mRng.range(100) < mSettings.density)
+        {
+            int light = lights.push();
+            lights.posX[light] = (int)x + 20;
+            lights.posY[light] = randomLightsY((int)shelves.posY[shelf], mRng);
+            lights.prevX[light] = lights.posX[light];
+            lights.prevY[light] = lights.posY[light];
+        }
+    }
+}
+
+//Boxes overlap when each starts before the other ends, on both axes
+int overlapScalar( const Sint32* minX, const Sint32* maxX, const Sint32* minY, const Sint32* maxY, int first, int count, const SDL_Rect& box )
+{
+    Sint32 left = box.x;
+    Sint32 right = box.x + box.w;
+    Sint32 top = box.y;
+    Sint32 bottom = box.y + box.h;
+
+    for (int i = first; i < count; ++i)
+    {
+        if (right > minX[i] && left < maxX[i] && bottom > minY[i] && top < maxY[i])
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+//Gets the lane of the lowest set bit in a non-zero lane mask
+int lowestLane( int lanes )
+{
+    int lane = 0;
+    while ((lanes & 1) == 0)
+    {
+        lanes >>= 1;
+        ++lane;
+    }
+    return lane;
+}
+
+#ifdef COLLIDE_X86
+TARGET_SSE2 int overlapSSE2( const Sint32* minX, const Sint32* maxX, const Sint32* minY, const Sint32* maxY, int first, int count, const SDL_Rect& box )
+{
+    __m128i left = _mm_set1_epi32(box.x);
+    __m128i right = _mm_set1_epi32(box.x + box.w);
+    __m128i top = _mm_set1_epi32(box.y);
+    __m128i bottom = _mm_set1_epi32(box.y + box.h);
+
+    for (int i = first & ~3; i < count; i += 4)
+    {
+        __m128i hit = _mm_and_si128(
+            _mm_and_si128(_mm_cmpgt_epi32(right, _mm_loadu_si128((const __m128i*)(minX + i))),
+                          _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)(maxX + i)), left)),
+            _mm_and_si128(_mm_cmpgt_epi32(bottom, _mm_loadu_si128((const __m128i*)(minY + i))),
+                          _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)(maxY + i)), top)));
+
+        //Lanes before first were tested by an earlier call
+        int lanes = _mm_movemask_ps(_mm_castsi128_ps(hit)) & (0xF << std::max(first - i, 0));
+        if (lanes != 0)
+        {
+            return i + lowestLane(lanes);
+        }
+    }
+
+    return -1;
+}
+
+TARGET_AVX2 int overlapAVX2( const Sint32* minX, const Sint32* maxX, const Sint32* minY, const Sint32* maxY, int first, int count, const SDL_Rect& box )
+{
+    __m256i left = _mm256_set1_epi32(box.x);
+    __m256i right = _mm256_set1_epi32(box.x + box.w);
+    __m256i top = _mm256_set1_epi32(box.y);
+    __m256i bottom = _mm256_set1_epi32(box.y + box.h);
+
+    for (int i = first & ~7; i < count; i += 8)
+    {
+        __m256i hit = _mm256_and_si256(
+            _mm256_and_si256(_mm256_cmpgt_epi32(right, _mm256_loadu_si256((const __m256i*)(minX + i))),
+                             _mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i*)(maxX + i)), left)),
+            _mm256_and_si256(_mm256_cmpgt_epi32(bottom, _mm256_loadu_si256((const __m256i*)(minY + i))),
+                             _mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i*)(maxY + i)), top)));
+
+        int lanes = _mm256_movemask_ps(_mm256_castsi256_ps(hit)) & (0xFF << std::max(first - i, 0));
+        if (lanes != 0)
+        {
+            return i + lowestLane(lanes);
+        }
+    }
+
+    return -1;
+}
+#endif
+
+OverlapKernel ColliderStore::sKernel = overlapScalar;
+const char* ColliderStore::sKernelName = "scalar";
+
+ColliderStore::ColliderStore()
+{
+    mCount = 0;
+}
+
+void ColliderStore::clear()
+{
+    mCount = 0;
+}
+
+void ColliderStore::add(const SDL_Rect& box)
+{
+    //Open a new block of padding boxes, empty so nothing can overlap them
+    if (mCount % LANES == 0)
+    {
+        if (mCount + LANES > (int)mMinX.size())
+        {
+            mMinX.resize(mCount + LANES);
+            mMaxX.resize(mCount + LANES);
+            mMinY.resize(mCount + LANES);
+            mMaxY.resize(mCount + LANES);
+        }
+
+        for (int i = mCount; i < mCount + LANES; ++i)
+        {
+            mMinX[i] = 0x7FFFFFFF;
+            mMaxX[i] = -0x7FFFFFFF - 1;
+            mMinY[i] = 0x7FFFFFFF;
+            mMaxY[i] = -0x7FFFFFFF - 1;
+        }
+    }
+
+    mMinX[mCount] = box.x;
+    mMaxX[mCount] = box.x + box.w;
+    mMinY[mCount] = box.y;
+    mMaxY[mCount] = box.y + box.h;
+    ++mCount;
+}
+
+int ColliderStore::size()
+{
+    return mCount;
+}
+
+int ColliderStore::findOverlap(const SDL_Rect& box, int first)
+{
+    if (first >= mCount)
+    {
+        return -1;
+    }
+
+    return sKernel(&mMinX[0], &mMaxX[0], &mMinY[0], &mMaxY[0], first, mCount, box);
+}
+
+CollisionMask::CollisionMask()
+{
+    mWidth = 0;
+    mHeight = 0;
+    mWordsPerRow = 0;
+    mBounds.x = 0;
+    mBounds.y = 0;
+    mBounds.w = 0;
+    mBounds.h = 0;
+}
+
+bool CollisionMask::build(SDL_Surface* surface, SDL_RendererFlip flip)
+{
+    if (surface->format->format != SDL_PIXELFORMAT_ARGB8888)
+    {
+        printf("Collision masks need ARGB8888 pixels!\n");
+        return false;
+    }
+
+    mWidth = surface->w;
+    mHeight = surface->h;
+    mWordsPerRow = (mWidth + 63) / 64;
+    mBits.assign(mWordsPerRow * mHeight, 0);
+
+    int minX = mWidth;
+    int minY = mHeight;
+    int maxX = -1;
+    int maxY = -1;
+
+    SDL_LockSurface(surface);
+    for (int y = 0; y < mHeight; ++y)
+    {
+        const Uint32* pixels = (const Uint32*)((const Uint8*)surface->pixels + y * surface->pitch);
+        int row = (flip & SDL_FLIP_VERTICAL) ? mHeight - 1 - y : y;
+
+        for (int x = 0; x < mWidth; ++x)
+        {
+            //The color key was turned into alpha when the sprite was decoded
+            if ((pixels[x] >> 24) < MASK_ALPHA_THRESHOLD)
+            {
+                continue;
+            }
+
+            int column = (flip & SDL_FLIP_HORIZONTAL) ? mWidth - 1 - x : x;
+            mBits[row * mWordsPerRow + column / 64] |= (Uint64)1 << (63 - column % 64);
+
+            minX = std::min(minX, column);
+            maxX = std::max(maxX, column);
+            minY = std::min(minY, row);
+            maxY = std::max(maxY, row);
+        }
+    }
+    SDL_UnlockSurface(surface);
+
+    //A fully transparent sprite never collides
+    if (maxX < 0)
+    {
+        minX = 0;
+        minY = 0;
+    }
+    mBounds.x = minX;
+    mBounds.y = minY;
+    mBounds.w = maxX + 1 - minX;
+    mBounds.h = maxY + 1 - minY;
+
+    return true;
+}
+
+const SDL_Rect& CollisionMask::getBounds() const
+{
+    return mBounds;
+}
+
+Uint64 CollisionMask::fetch(int y, int x) const
+{
+    const Uint64* row = &mBits[y * mWordsPerRow];
+    int word = x / 64;
+    int shift = x % 64;
+
+    //Rows are zero past the right edge, so words never need masking
+    Uint64 bits = row[word] << shift;
+    if (shift != 0 && word + 1 < mWordsPerRow)
+    {
+        bits |= row[word + 1] >> (64 - shift);
+    }
+    return bits;
+}
+
+bool CollisionMask::overlaps(const CollisionMask& other, int dx, int dy) const
+{
+    //Only where the opaque bounds of both meet
+    int left = std::max((int)mBounds.x, dx + other.mBounds.x);
+    int right = std::min(mBounds.x + mBounds.w, dx + other.mBounds.x + other.mBounds.w);
+    int top = std::max((int)mBounds.y, dy + other.mBounds.y);
+    int bottom = std::min(mBounds.y + mBounds.h, dy + other.mBounds.y + other.mBounds.h);
+
+    //64 pixels of both rows at a time
+    for (int y = top; y < bottom; ++y)
+    {
+        for (int x = left; x < right; x += 64)
+        {
+            if ((fetch(y, x) & other.fetch(y - dy, x - dx)) != 0)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool CollisionMask::isOpaque(int x, int y) const
+{
+    return ((mBits[y * mWordsPerRow + x / 64] >> (63 - x % 64)) & 1) != 0;
+}
+
+int CollisionMask::getOpaqueCount() const
+{
+    int count = 0;
+    for (int y = 0; y < mHeight; ++y)
+    {
+        for (int x = 0; x < mWidth; ++x)
+        {
+            count += isOpaque(x, y);
+        }
+    }
+    return count;
+}
+
+void CollisionMask::generateHitboxes(int maxBoxes, std::vector<SDL_Rect>& boxes, std::vector<int>& errors) const
+{
+    //Horizontal extent and opaque pixels of every row, empty rows have left > right
+    std::vector<int> left(mHeight, mWidth);
+    std::vector<int> right(mHeight, -1);
+    std::vector<int> opaque(mHeight, 0);
+    for (int y = 0; y < mHeight; ++y)
+    {
+        for (int x = 0; x < mWidth; ++x)
+        {
+            if (isOpaque(x, y))
+            {
+                left[y] = std::min(left[y], x);
+                right[y] = std::max(right[y], x);
+                ++opaque[y];
+            }
+        }
+    }
+
+    //error[k][i] is the fewest transparent pixels covered when rows [0, i) are covered by k bands,
+    //from[k][i] is where the last band starts, or SKIP_ROW for an empty row left out, or
+    //FEWER_BOXES when k - 1 bands do as well
+    const int NONE = 0x7FFFFFFF;
+    const int SKIP_ROW = -1;
+    const int FEWER_BOXES = -2;
+    int rows = mHeight + 1;
+    std::vector<int> error((maxBoxes + 1) * rows, NONE);
+    std::vector<int> from((maxBoxes + 1) * rows, SKIP_ROW);
+
+    //With no bands only empty rows can be covered
+    error[0] = 0;
+    for (int i = 1; i < rows && right[i - 1] < 0; ++i)
+    {
+        error[i] = 0;
+    }
+
+    for (int k = 1; k <= maxBoxes; ++k)
+    {
+        int* best = &error[k * rows];
+        const int* fewer = &error[(k - 1) * rows];
+        int* start = &from[k * rows];
+
+        best[0] = 0;
+        for (int i = 1; i < rows; ++i)
+        {
+            best[i] = fewer[i];
+            start[i] = FEWER_BOXES;
+
+            if (right[i - 1] < 0 && best[i - 1] < best[i])
+            {
+                best[i] = best[i - 1];
+                start[i] = SKIP_ROW;
+            }
+
+            //Grow the last band upwards from row i - 1
+            int bandLeft = mWidth;
+            int bandRight = -1;
+            int bandOpaque = 0;
+            for (int j = i - 1; j >= 0; --j)
+            {
+                bandLeft = std::min(bandLeft, left[j]);
+                bandRight = std::max(bandRight, right[j]);
+                bandOpaque += opaque[j];
+
+                if (fewer[j] == NONE || bandRight < 0)
+                {
+                    continue;
+                }
+
+                int covered = fewer[j] + (bandRight + 1 - bandLeft) * (i - j) - bandOpaque;
+                if (covered < best[i])
+                {
+                    best[i] = covered;
+                    start[i] = j;
+                }
+            }
+        }
+    }
+
+    errors.resize(maxBoxes);
+    for (int k = 1; k <= maxBoxes; ++k)
+    {
+        errors[k - 1] = error[k * rows + mHeight];
+    }
+
+    //Walk the choices back from the last row
+    boxes.clear();
+    int k = maxBoxes;
+    int i = mHeight;
+    while (i > 0 && k > 0)
+    {
+        int j = from[k * rows + i];
+        if (j == FEWER_BOXES)
+        {
+            --k;
+        }
+        else if (j == SKIP_ROW)
+        {
+            --i;
+        }
+        else
+        {
+            SDL_Rect box = { mWidth, j, 0, i - j };
+            int boxRight = -1;
+            for (int y = j; y < i; ++y)
+            {
+                box.x = std::min(box.x, left[y]);
+                boxRight = std::max(boxRight, right[y]);
+            }
+            box.w = boxRight + 1 - box.x;
+            boxes.insert(boxes.begin(), box);
+
+            --k;
+            i = j;
+        }
+    }
+}
+
+bool ColliderStore::selectKernel(const char* name)
+{
+    bool isAuto = strcmp(name, "auto") == 0;
+
+#ifdef COLLIDE_X86
+    if ((isAuto || strcmp(name, "avx2") == 0) && SDL_HasAVX2())
+    {
+        sKernel = overlapAVX2;
+        sKernelName = "avx2";
+        return true;
+    }
+
+    if ((isAuto || strcmp(name, "sse2") == 0) && SDL_HasSSE2())
+    {
+        sKernel = overlapSSE2;
+        sKernelName = "sse2";
+        return true;
+    }
+#endif
+
+    if (isAuto || strcmp(name, "scalar") == 0)
+    {
+        sKernel = overlapScalar;
+        sKernelName = "scalar";
+        return true;
+    }
+
+    return false;
+}
+
+const char* ColliderStore::getKernelName()
+{
+    return sKernelName;
+}
+
+World::World()
+{
+    phaseTimes = NULL;
+    scrolled = 0.0;
+    prevScrolled = 0.0;
+    tick = 0;
+    score = 0;
+    ended = false;
+}
+
+void World::reset( Uint32 seed, const ObstacleSettings &settings )
+{
+    //Roach starts in the middle of the screen
+    EntityPool &roach = entities[ENTITY_ROACH];
+    roach.resize(1);
+    roach.push();
+    roach.posX[0] = (SCREEN_WIDTH / 2) - (ROACH_WIDTH / 2);
+    roach.posY[0] = SCREEN_HEIGHT / 2 - (ROACH_HEIGHT / 2);
+    roach.prevX[0] = roach.posX[0];
+    roach.prevY[0] = roach.posY[0];
+
+    //Fixed size rings, streaming never allocates
+    entities[ENTITY_SHELF].resize(settings.capacity);
+    entities[ENTITY_LIGHTS].resize(settings.capacity);
+
+    generator.reset(seed, settings);
+    generator.generate(entities[ENTITY_SHELF], entities[ENTITY_LIGHTS]);
+
+    scrolled = 0.0;
+    prevScrolled = 0.0;
+    tick = 0;
+    score = 0;
+    ended = false;
+}
+
+bool World::handleInput( InputAction action )
+{
+    float &rVel = entities[ENTITY_ROACH].rVel;
+
+    //If a flap was pressed
+    if( action == INPUT_FLAP_PRESS && rVel >= GRAVITY / 8.0f)
+    {
+        //Adjust the velocity
+        rVel = -GRAVITY / 2.2f;
+        return true;
+    }
+    //If a flap was released
+    else if( action == INPUT_FLAP_RELEASE )
+    {
+        //Adjust the velocity
+        rVel += GRAVITY / 8.0f;
+        return true;
+    }
+    return false;
+}
+
+void World::step( float dt )
+{
+    if (ended)
+    {
+        return;
+    }
+
+    //Apply acceleration and gravity
+    {
+        ScopedTimer timer(PHASE_PHYSICS, phaseTimes);
+
+        accelerate(dt);
+    }
+
+    //Move and check collision
+    {
+        ScopedTimer timer(PHASE_COLLISION, phaseTimes);
+
+        move(dt);
+        stream();
+
+        if (collide())
+        {
+            ended = true;
+        }
+    }
+
+    //Scroll background
+    prevScrolled = scrolled;
+    scrolled += REFERENCE_FPS * dt;
+
+    //Scoring
+    ++tick;
+    {
+        ScopedTimer timer(PHASE_SCORE, phaseTimes);
+        calculateScore(*this);
+    }
+}
+
+void World::accelerate( float dt )
+{
+    for (int kind = 0; kind < NUM_OF_ENTITY_KINDS; ++kind)
+    {
+        EntityPool &pool = entities[kind];
+
+        pool.rVel += ENTITY_KINDS[kind].acceleration * dt;
+        pool.vel = (int)pool.rVel;
+    }
+}
+
+void World::move( float dt )
+{
+    for (int kind = 0; kind < NUM_OF_ENTITY_KINDS; ++kind)
+    {
+        EntityPool &pool = entities[kind];
+        const EntityKindInfo &info = ENTITY_KINDS[kind];
+
+        if (pool.vel >= info.maxVel)
+        {
+            pool.vel = info.maxVel;
+        }
+
+        //Velocities are in pixels per reference frame
+        float step = pool.vel * REFERENCE_FPS * dt;
+
+        //Only the live slots, the rest are placed afresh when they come live
+        for (int k = 0; k < pool.count; ++k)
+        {
+            int i = pool.slot(k);
+
+            pool.prevX[i] = pool.posX[i];
+            pool.prevY[i] = pool.posY[i];
+            pool.posX[i] += info.dirX * step;
+            pool.posY[i] += info.dirY * step;
+        }
+    }
+}
+
+void World::stream()
+{
+    EntityPool &shelves = entities[ENTITY_SHELF];
+    EntityPool &lights = entities[ENTITY_LIGHTS];
+
+    //The oldest obstacles are always the leftmost
+    while (shelves.count > 0 && shelves.posX[shelves.slot(0)] + SHELF_WIDTH < 0)
+    {
+        shelves.pop();
+    }
+    while (lights.count > 0 && lights.posX[lights.slot(0)] + LIGHTS_WIDTH < 0)
+    {
+        lights.pop();
+    }
+
+    generator.generate(shelves, lights);
+}
+
+bool World::collide()
+{
+    EntityPool &roach = entities[ENTITY_ROACH];
+    bool hit = false;
+
+    //If the roach went too far up or down
+    if (( roach.posY[0] < 0 ) || ( roach.posY[0] + ROACH_HEIGHT > SCREEN_HEIGHT ))
+    {
+        //Move back
+        roach.posY[0] = roach.prevY[0];
+        hit = true;
+    }
+
+    //Only obstacles whose x-interval overlaps the roach reach the narrow phase
+    int minX;
+    int maxX;
+    kindSpan(ENTITY_ROACH, minX, maxX);
+    minX += (int)roach.posX[0];
+    maxX += (int)roach.posX[0];
+
+    narrowPhase.clear();
+    candidates.clear();
+    for (int kind = ENTITY_SHELF; kind < NUM_OF_ENTITY_KINDS; ++kind)
+    {
+        const std::vector<SDL_Rect> &boxes = gEntityHitboxes[kind];
+
+        int first;
+        int last;
+        findOverlapping(kind, minX, maxX, first, last);
+        for (int k = first; k < last; ++k)
+        {
+            EntityRef candidate = { kind, entities[kind].slot(k) };
+            for (int b = 0; b < (int)boxes.size(); ++b)
+            {
+                narrowPhase.add(place(candidate.kind, candidate.index, boxes[b]));
+                candidates.push_back(candidate);
+            }
+        }
+    }
+
+    //Test each of the roach's boxes against all of them at once, then the masks where boxes meet
+    const std::vector<SDL_Rect> &roachBoxes = gEntityHitboxes[ENTITY_ROACH];
+    for (int b = 0; b < (int)roachBoxes.size() && !hit; ++b)
+    {
+        SDL_Rect box = place(ENTITY_ROACH, 0, roachBoxes[b]);
+        for (int i = narrowPhase.findOverlap(box, 0); i >= 0 && !hit; i = narrowPhase.findOverlap(box, i + 1))
+        {
+            hit = gCollisionSettings.boxesOnly || masksOverlap(candidates[i]);
+        }
+    }
+
+    return hit;
+}
+
+void World::findOverlapping( int kind, int minX, int maxX, int &first, int &last )
+{
+    EntityPool &pool = entities[kind];
+
+    int spanMin;
+    int spanMax;
+    kindSpan(kind, spanMin, spanMax);
+
+    //Rings are in x order, so binary search for the first one reaching past minX
+    int lo = 0;
+    int hi = pool.count;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if ((int)pool.posX[pool.slot(mid)] + spanMax <= minX)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    first = lo;
+    last = lo;
+    while (last < pool.count && (int)pool.posX[pool.slot(last)] + spanMin < maxX)
+    {
+        ++last;
+    }
+}
+
+SDL_Rect World::place( int kind, int index, const SDL_Rect &box )
+{
+    SDL_Rect placed = box;
+    placed.x += (int)entities[kind].posX[index];
+    placed.y += (int)entities[kind].posY[index];
+    return placed;
+}
+
+bool World::masksOverlap( const EntityRef &obstacle )
+{
+    EntityPool &roach = entities[ENTITY_ROACH];
+    EntityPool &pool = entities[obstacle.kind];
+    int dx = (int)pool.posX[obstacle.index] - (int)roach.posX[0];
+    int dy = (int)pool.posY[obstacle.index] - (int)roach.posY[0];
+
+    return gEntityMasks[ENTITY_ROACH].overlaps(gEntityMasks[obstacle.kind], dx, dy);
+}
+
+void World::capture( WorldSnapshot &snapshot )
+{
+    snapshot.tick = tick;
+    snapshot.score = score;
+    snapshot.ended = ended;
+    snapshot.scrolled = scrolled;
+    snapshot.prevScrolled = prevScrolled;
+
+    for (int phase = 0; phase < NUM_OF_PHASES; ++phase)
+    {
+        snapshot.phaseTimes[phase] = phaseTimes != NULL ? phaseTimes[phase] : 0;
+    }
+
+    for (int kind = 0; kind < NUM_OF_ENTITY_KINDS; ++kind)
+    {
+        EntityPool &pool = entities[kind];
+        std::vector<SpritePosition> &sprites = snapshot.sprites[kind];
+        sprites.clear();
+
+        //Skip obstacles generated ahead off screen, with room for interpolation
+        int first = 0;
+        int last = pool.count;
+        if (kind != ENTITY_ROACH)
+        {
+            findOverlapping(kind, -RENDER_MARGIN, SCREEN_WIDTH + RENDER_MARGIN, first, last);
+        }
+
+        for (int k = first; k < last; ++k)
+        {
+            int index = pool.slot(k);
+            SpritePosition sprite = { pool.prevX[index], pool.prevY[index], pool.posX[index], pool.posY[index] };
+            sprites.push_back(sprite);
+        }
+    }
+}
+
+void renderSnapshot( const WorldSnapshot &snapshot, float alpha )
+{
+    //Render background layers, each at its own scroll rate
+    {
+        ScopedTimer timer(PHASE_BACKGROUND);
+
+        gBackgroundLayers.render(snapshot.prevScrolled + (snapshot.scrolled - snapshot.prevScrolled) * alpha);
+    }
+
+    //Render objects, interpolated between the last two ticks
+    {
+        ScopedTimer timer(PHASE_SPRITES);
+
+        for (int kind = 0; kind < NUM_OF_ENTITY_KINDS; ++kind)
+        {
+            const std::vector<SpritePosition> &sprites = snapshot.sprites[kind];
+            for (size_t i = 0; i < sprites.size(); ++i)
+            {
+                int x = (int)(sprites[i].prevX + (sprites[i].x - sprites[i].prevX) * alpha);
+                int y = (int)(sprites[i].prevY + (sprites[i].y - sprites[i].prevY) * alpha);
+                gSpriteAtlas.draw( ENTITY_KINDS[kind].sprite, x, y, ENTITY_KINDS[kind].flip );
+            }
+        }
+
+        //Objects go out in one draw call
+        gSpriteAtlas.flush();
+    }
+}
+
+SnapshotBuffer::SnapshotBuffer()
+{
+    //Initialize
+    reset( 0 );
+}
+
+void SnapshotBuffer::reset( int capacity )
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int kind = 0; kind < NUM_OF_ENTITY_KINDS; ++kind)
+        {
+            //Filling a snapshot never allocates
+            mSlots[i].sprites[kind].clear();
+            mSlots[i].sprites[kind].reserve(kind == ENTITY_ROACH ? 1 : capacity);
+        }
+    }
+
+    mBack = 0;
+    mFront = 2;
+    SDL_AtomicSet( &mMiddle, 1 );
+}
+
+WorldSnapshot& SnapshotBuffer::getBack()
+{
+    return mSlots[ mBack ];
+}
+
+void SnapshotBuffer::publish()
+{
+    //The snapshot's contents land before the swap that hands it over
+    SDL_MemoryBarrierRelease();
+    mBack = SDL_AtomicSet( &mMiddle, mBack | FRESH ) & INDEX_MASK;
+}
+
+bool SnapshotBuffer::acquire()
+{
+    if( ( SDL_AtomicGet( &mMiddle ) & FRESH ) == 0 )
+    {
+        return false;
+    }
+
+    mFront = SDL_AtomicSet( &mMiddle, mFront ) & INDEX_MASK;
+    SDL_MemoryBarrierAcquire();
+    return true;
+}
+
+const WorldSnapshot& SnapshotBuffer::getFront()
+{
+    return mSlots[ mFront ];
+}
+
+bool init()
+{
+	//Initialization flag
+	bool success = true;
+
+	//Initialize SDL
+	if( SDL_Init( SDL_INIT_VIDEO ) < 0 )
+	{
+		printf( "SDL could not initialize! SDL Error: %s\n", SDL_GetError() );
+		success = false;
+	}
+	else
+	{
+		//Set texture filtering to linear
+		if( !SDL_SetHint( SDL_HINT_RENDER_SCALE_QUALITY, "1" ) )
+		{
+			printf( "Warning: Linear texture filtering not enabled!" );
+		}
+
+		//Create window
+		gWindow = SDL_CreateWindow( "Cocky Roach", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN );
+		if( gWindow == NULL )
+		{
+			printf( "Window could not be created! SDL Error: %s\n", SDL_GetError() );
+			success = false;
+		}
+		else
+		{
+			//Create renderer for window, vsynced for the modes that wait on the refresh
+			Uint32 flags = SDL_RENDERER_ACCELERATED;
+			if( gPacing == PACING_VSYNC || gPacing == PACING_ADAPTIVE )
+			{
+				flags |= SDL_RENDERER_PRESENTVSYNC;
+			}
+			gRenderer = SDL_CreateRenderer( gWindow, -1, flags );
+			if( gRenderer == NULL )
+			{
+				printf( "Renderer could not be created! SDL Error: %s\n", SDL_GetError() );
+				success = false;
+			}
+			else
+			{
+				resolvePacing();
+
+				//Initialize renderer color
+				SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
+
+				//Initialize PNG loading
+				int imgFlags = IMG_INIT_PNG;
+				if( !( IMG_Init( imgFlags ) & imgFlags ) )
+				{
+					printf( "SDL_image could not initialize! SDL_image Error: %s\n", IMG_GetError() );
+					success = false;
+				}
+
+				//Initialize SDL_ttf
+                if( TTF_Init() == -1 )
+                {
+                    printf( "SDL_ttf could not initialize! SDL_ttf Error: %s\n", TTF_GetError() );
+                    success = false;
+                }
+			}
+		}
+	}
+
+	return success;
+}
+
+SDL_Surface* loadSurface( std::string path )
+{
+	//Load image at specified path
+	SDL_Surface* loadedSurface = IMG_Load( path.c_str() );
+	if( loadedSurface == NULL )
+	{
+		printf( "Unable to load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError() );
+	}
+	else
+	{
+		//Color key image
+		SDL_SetColorKey( loadedSurface, SDL_TRUE, SDL_MapRGB( loadedSurface->format, 0, 0xFF, 0xFF ) );
+	}
+
+	return loadedSurface;
+}
+
+SDL_Surface* decodeSprite( SpriteId sprite )
+{
+	if( gAssetPack.isOpen() )
+	{
+		return gAssetPack.createSurface( sprite );
+	}
+
+	//The atlas and masks take ARGB8888, converting also turns the color key into alpha
+	SDL_Surface* surface = NULL;
+	SDL_Surface* loadedSurface = loadSurface( SPRITE_PATHS[ sprite ] );
+	if( loadedSurface != NULL )
+	{
+		surface = SDL_ConvertSurfaceFormat( loadedSurface, SDL_PIXELFORMAT_ARGB8888, 0 );
+		SDL_FreeSurface( loadedSurface );
+	}
+	return surface;
+}
+
+bool buildCollisionMasks( SpriteId sprite, SDL_Surface* surface )
+{
+	std::vector<int> errors;
+	for( int kind = 0; kind < NUM_OF_ENTITY_KINDS; ++kind )
+	{
+		if( ENTITY_KINDS[ kind ].sprite != sprite )
+		{
+			continue;
+		}
+
+		if( !gEntityMasks[ kind ].build( surface, ENTITY_KINDS[ kind ].flip ) )
+		{
+			return false;
+		}
+
+		//Boxes cover every opaque pixel, so they can pass contacts on to the masks
+		gEntityMasks[ kind ].generateHitboxes( gCollisionSettings.hitboxes, gEntityHitboxes[ kind ], errors );
+	}
+	return true;
+}
+
+bool loadCollisionMasks()
+{
+	TraceScope trace( "load collision masks" );
+
+	//PNGs are only decoded when there is no archive
+	if( !gAssetPack.open( ASSET_PACK_PATH ) && !( IMG_Init( IMG_INIT_PNG ) & IMG_INIT_PNG ) )
+	{
+		printf( "SDL_image could not initialize! SDL_image Error: %s\n", IMG_GetError() );
+		return false;
+	}
+
+	for( int kind = 0; kind < NUM_OF_ENTITY_KINDS; ++kind )
+	{
+		SpriteId sprite = ENTITY_KINDS[ kind ].sprite;
+		SDL_Surface* surface = decodeSprite( sprite );
+		if( surface == NULL )
+		{
+			printf( "Failed to load sprite %s!\n", SPRITE_PATHS[ sprite ] );
+			return false;
+		}
+
+		bool built = buildCollisionMasks( sprite, surface );
+		SDL_FreeSurface( surface );
+		if( !built )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int reportHitboxes()
+{
+	if( !loadCollisionMasks() )
+	{
+		return 1;
+	}
+
+	for( int kind = 0; kind < NUM_OF_ENTITY_KINDS; ++kind )
+	{
+		const CollisionMask& mask = gEntityMasks[ kind ];
+		int opaque = mask.getOpaqueCount();
+		printf( "%s: %d opaque pixels\n", SPRITE_PATHS[ ENTITY_KINDS[ kind ].sprite ], opaque );
+
+		//Error is the transparent pixels the boxes cover, nothing opaque is ever left out
+		std::vector<SDL_Rect> boxes;
+		std::vector<int> errors;
+		mask.generateHitboxes( MAX_NUM_OF_HITBOXES, boxes, errors );
+		for( int k = 1; k <= MAX_NUM_OF_HITBOXES; ++k )
+		{
+			printf( "  %2d box(es): %6d pixels over (%5.1f%%)%s\n", k, errors[ k - 1 ], opaque > 0 ? 100.0 * errors[ k - 1 ] / opaque : 0.0, k == gCollisionSettings.hitboxes ? " <- in use" : "" );
+		}
+
+		const std::vector<SDL_Rect>& used = gEntityHitboxes[ kind ];
+		for( size_t i = 0; i < used.size(); ++i )
+		{
+			printf( "  { %d, %d, %d, %d }\n", used[ i ].x, used[ i ].y, used[ i ].w, used[ i ].h );
+		}
+	}
+
+	gAssetPack.close();
+	IMG_Quit();
+	SDL_Quit();
+	return 0;
+}
+
+int testCollideKernels()
+{
+	//Put back whatever was picked once done
+	const char* selected = ColliderStore::getKernelName();
+
+	const char* kernels[] = { "sse2", "avx2" };
+	int numKernels = sizeof( kernels ) / sizeof( kernels[ 0 ] );
+
+	int failures = 0;
+	for( int k = 0; k < numKernels; ++k )
+	{
+		if( !ColliderStore::selectKernel( kernels[ k ] ) )
+		{
+			printf( "%s: not supported by this CPU, skipped\n", kernels[ k ] );
+			continue;
+		}
+
+		//Same sets for every kernel, packed into a small area so boxes overlap often. Counts
+		//run past whole lane blocks and every first offset is tried, empty boxes included
+		Random rng( 1 );
+		int mismatches = 0;
+		int queries = 0;
+		for( int set = 0; set < COLLIDE_TEST_SETS; ++set )
+		{
+			ColliderStore store;
+			int count = rng.range( COLLIDE_TEST_MAX_BOXES + 1 );
+			for( int i = 0; i < count; ++i )
+			{
+				SDL_Rect box = { rng.range( 96 ) - 16, rng.range( 96 ) - 16, rng.range( 17 ), rng.range( 17 ) };
+				store.add( box );
+			}
+
+			SDL_Rect box = { rng.range( 96 ) - 16, rng.range( 96 ) - 16, rng.range( 33 ), rng.range( 33 ) };
+			for( int first = 0; first <= count; ++first )
+			{
+				ColliderStore::selectKernel( "scalar" );
+				int expected = store.findOverlap( box, first );
+				ColliderStore::selectKernel( kernels[ k ] );
+				int found = store.findOverlap( box, first );
+				++queries;
+
+				if( found != expected )
+				{
+					//A few are enough to go on
+					if( mismatches < 10 )
+					{
+						printf( "%s: set %d of %d boxes from %d found %d, scalar %d\n", kernels[ k ], set, count, first, found, expected );
+					}
+					++mismatches;
+				}
+			}
+		}
+
+		printf( "%s: %d of %d queries over %d box sets differ from scalar\n", kernels[ k ], mismatches, queries, COLLIDE_TEST_SETS );
+		if( mismatches > 0 )
+		{
+			++failures;
+		}
+	}
+
+	ColliderStore::selectKernel( selected );
+	return failures > 0 ? 1 : 0;
+}
+
+bool loadMedia()
+{
+	TraceScope trace( "loadMedia" );
+
+	//Loading success flag
+	bool success = true;
+
+	//Pre-decoded pixels skip PNG decoding and color keying entirely
+	gTrace.begin( "map assets.pak" );
+	bool packed = gAssetPack.open( ASSET_PACK_PATH );
+	gTrace.end( "map assets.pak" );
+
+	//Decode sprites on the worker pool while the font is set up here
+	if( !gSpriteAtlas.create() || !gAssetLoader.start() )
+	{
+		printf( "Failed to start loading sprites!\n" );
+		return false;
+	}
+
+	//Open the font
+	gTrace.begin( "load lazy.ttf" );
+    gFont = packed ? gAssetPack.openFont( FONT_SIZE ) : TTF_OpenFont( FONT_PATH, FONT_SIZE );
+    if( gFont == NULL )
+    {
+        printf( "Failed to load lazy font! SDL_ttf Error: %s\n", TTF_GetError() );
+        success = false;
+    }
+    //Rasterize the font once for all text drawing
+    else if( !gTextAtlas.loadFromFont( gFont ) )
+    {
+        printf( "Failed to build text atlas!\n" );
+        success = false;
+    }
+	gTrace.end( "load lazy.ttf" );
+
+	//Scores are read once, saving happens in the background
+	gScoreHistory.load( SCORE_HISTORY_PATH, SCORE_LOG_PATH, HIGH_SCORE_PATH );
+
+	//The menu can show once its logo is in, the rest keeps streaming
+	if( success && !gAssetLoader.waitFor( SPRITE_COCKY ) )
+	{
+		printf( "Failed to load menu logo!\n" );
+		success = false;
+	}
+
+	return success;
+}
+
+void close()
+{
+	//Let the last scores reach the disk
+	gScoreHistory.stop();
+
+	//Free loaded images
+	gAssetLoader.stop();
+	gBackgroundLayers.free();
+	gSpriteAtlas.free();
+	gTextAtlas.free();
+
+    //Free global font
+    TTF_CloseFont( gFont );
+    gFont = NULL;
+
+	//The font was the last reader of the archive
+	gAssetPack.close();
+
+	//Destroy window
+	SDL_DestroyRenderer( gRenderer );
+	SDL_DestroyWindow( gWindow );
+	gWindow = NULL;
+	gRenderer = NULL;
+
+	//Quit SDL subsystems
+	TTF_Quit();
+	IMG_Quit();
+	SDL_Quit();
+}
+
+float randomShelfY(Random &rng)
+{
+    int randomHeight;
+
+    randomHeight = 50 + rng.range(SCREEN_HEIGHT + 1) - 50;
+
+    if (randomHeight < (SCREEN_HEIGHT / 3))
+    {
+        randomHeight += 100;
+    }
+    return randomHeight;
+}
+
+float randomLightsY(int shelf_y_position, Random &rng)
+{
+    int randomHeight;
+
+    randomHeight = rng.range(LIGHTS_HEIGHT - 100);
+
+    float posY = randomHeight * (-1);
+
+    int lightsPosition = posY + LIGHTS_HEIGHT;
+
+    if (lightsPosition >= shelf_y_position - 200)
+    {
+        posY = shelf_y_position - LIGHTS_HEIGHT - 100;
+    }
+
+    if (posY + LIGHTS_HEIGHT >= SCREEN_HEIGHT - 100)
+    {
+        posY -= 150;
+    }
+    return posY;
+}
+
+bool translateInput( SDL_Event& e, InputAction& action )
+{
+    if( e.type == SDL_KEYDOWN && e.key.repeat == 0 && e.key.keysym.sym == SDLK_SPACE )
+    {
+        action = INPUT_FLAP_PRESS;
+        return true;
+    }
+
+    if( e.type == SDL_KEYUP && e.key.repeat == 0 && e.key.keysym.sym == SDLK_SPACE )
+    {
+        action = INPUT_FLAP_RELEASE;
+        return true;
+    }
+
+    return false;
+}
+
+Scene::Scene( const char* name )
+{
+    mName = name;
+    mDirty = true;
+}
+
+Scene::~Scene()
+{
+}
+
+void Scene::enter()
+{
+    mDirty = true;
+}
+
+Uint32 Scene::getWaitTimeout()
+{
+    return IDLE_WAIT_MS;
+}
+
+int Scene::getFrameRate()
+{
+    return SCENE_FRAME_RATE;
+}
+
+bool Scene::needsRender()
+{
+    return mDirty;
+}
+
+void Scene::invalidate()
+{
+    mDirty = true;
+}
+
+void Scene::setWindowState( bool, bool )
+{
+}
+
+const char* Scene::getName()
+{
+    return mName;
+}
+
+MenuScene::MenuScene() : Scene( "menu frame" )
+{
+    mLabels[0] = "New Game";
+    mLabels[1] = "High Score";
+    mLabels[2] = "Exit";
+    mHovered = -1;
+    mLoadedCount = 0;
+
+    int offset1 = 50;
+    int offset2 = 0;
+
+    for (int i = 0; i < NUM_OF_MENU; ++i)
+    {
+        mItemRects[i].w = gTextAtlas.getTextWidth(mLabels[i]);
+        mItemRects[i].h = gTextAtlas.getHeight();
+        mItemRects[i].x = ( SCREEN_WIDTH - mItemRects[i].w ) / 2;
+        mItemRects[i].y = (offset2 + (100 + SCREEN_HEIGHT - mItemRects[i].h ) / 2 ) - offset1;
+        offset1 -= 10;
+        offset2 += mItemRects[i].h;
+    }
+}
+
+int MenuScene::findItem( int x, int y )
+{
+    for (int i = 0; i < NUM_OF_MENU; ++i)
+    {
+        if (x >= mItemRects[i].x && x <= mItemRects[i].x + mItemRects[i].w &&
+            y >= mItemRects[i].y && y <= mItemRects[i].y + mItemRects[i].h)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+SceneId MenuScene::handleEvent( SDL_Event& e )
+{
+    int x;
+    int y;
+
+    switch(e.type) {
+    case SDL_QUIT:
+        return SCENE_QUIT;
+    case SDL_MOUSEMOTION:
+        SDL_GetMouseState( &x, &y );
+
+        //Hover only switches the color a label is drawn with, redraw when it moves to another item
+        {
+            int hovered = findItem(x, y);
+            if (hovered != mHovered)
+            {
+                mHovered = hovered;
+                mDirty = true;
+            }
+        }
+        break;
+    case SDL_MOUSEBUTTONDOWN:
+        SDL_GetMouseState( &x, &y );
+
+        switch (findItem(x, y))
+        {
+        case 0:
+            //The game waits for the rest of the sprites and its background behind a progress bar
+            return gBackgroundLayers.isCreated() ? SCENE_GAME : SCENE_LOADING;
+        case 1:
+            return SCENE_HIGH_SCORE;
+        case 2:
+            return SCENE_QUIT;
+        }
+        break;
+    }
+    return SCENE_MENU;
+}
+
+SceneId MenuScene::update()
+{
+    //Keep streaming sprites in while the menu is up
+    gAssetLoader.pump();
+
+    //An upload can move the logo within the atlas
+    if (gAssetLoader.getLoadedCount() != mLoadedCount)
+    {
+        mLoadedCount = gAssetLoader.getLoadedCount();
+        mDirty = true;
+    }
+    return SCENE_MENU;
+}
+
+Uint32 MenuScene::getWaitTimeout()
+{
+    //Wake up for decoded sprites until they are all in
+    if (!gAssetLoader.isDone() && !gAssetLoader.hasFailed())
+    {
+        return LOADER_PUMP_MS;
+    }
+    return IDLE_WAIT_MS;
+}
+
+void MenuScene::render()
+{
+    SDL_Color color[2] = {{0, 0, 0, 0xFF}, {193, 0, 0, 0xFF}};
+
+    //Clear screen
+    SDL_SetRenderDrawColor( gRenderer, 239, 228, 176, 0x0 );
+    SDL_RenderClear( gRenderer );
+
+    gSpriteAtlas.draw(SPRITE_COCKY, (SCREEN_WIDTH - gSpriteAtlas.getWidth(SPRITE_COCKY)) / 2, 50);
+    gSpriteAtlas.flush();
+    for (int i = 0; i < NUM_OF_MENU; ++i)
+    {
+        gTextAtlas.render(mItemRects[i].x, mItemRects[i].y, mLabels[i], color[i == mHovered ? 1 : 0]);
+    }
+    //Update screen
+    SDL_RenderPresent( gRenderer );
+    LTexture::endStatsFrame();
+
+    mDirty = false;
+}
+
+LoadingScene::LoadingScene() : Scene( "loading frame" )
+{
+    mLoadedCount = 0;
+}
+
+void LoadingScene::enter()
+{
+    Scene::enter();
+    mLoadedCount = gAssetLoader.getLoadedCount();
+}
+
+SceneId LoadingScene::handleEvent( SDL_Event& e )
+{
+    if( e.type == SDL_QUIT )
+    {
+        return SCENE_QUIT;
+    }
+    return SCENE_LOADING;
+}
+
+SceneId LoadingScene::update()
+{
+    gAssetLoader.pump();
+    if( gAssetLoader.hasFailed() )
+    {
+        printf( "Failed to load media!\n" );
+        return SCENE_QUIT;
+    }
+
+    if( gAssetLoader.isDone() )
+    {
+        //Build the background behind one more loading frame, the game's frames create no textures
+        if( !gBackgroundLayers.isCreated() && gBackgroundLayers.create() )
+        {
+            mLoadedCount = gAssetLoader.getLoadedCount();
+            mDirty = true;
+            return SCENE_LOADING;
+        }
+        return SCENE_GAME;
+    }
+
+    //Redraw only when the bar grows
+    if( gAssetLoader.getLoadedCount() != mLoadedCount )
+    {
+        mLoadedCount = gAssetLoader.getLoadedCount();
+        mDirty = true;
+    }
+    return SCENE_LOADING;
+}
+
+Uint32 LoadingScene::getWaitTimeout()
+{
+    return LOADER_PUMP_MS;
+}
+
+void LoadingScene::render()
+{
+    SDL_Color textColor = { 0, 0, 0, 0xFF };
+    const char* label = "Loading...";
+
+    //Clear screen
+    SDL_SetRenderDrawColor( gRenderer, 239, 228, 176, 0xFF );
+    SDL_RenderClear( gRenderer );
+
+    gSpriteAtlas.draw( SPRITE_COCKY, ( SCREEN_WIDTH - gSpriteAtlas.getWidth( SPRITE_COCKY ) ) / 2, 50 );
+    gSpriteAtlas.flush();
+
+    //Progress bar
+    SDL_Rect frame = { SCREEN_WIDTH / 4, SCREEN_HEIGHT / 2, SCREEN_WIDTH / 2, 20 };
+    SDL_Rect fill = { frame.x + 2, frame.y + 2, ( frame.w - 4 ) * mLoadedCount / NUM_OF_SPRITES, frame.h - 4 };
+    SDL_SetRenderDrawColor( gRenderer, 0, 0, 0, 0xFF );
+    SDL_RenderDrawRect( gRenderer, &frame );
+    SDL_SetRenderDrawColor( gRenderer, 193, 0, 0, 0xFF );
+    SDL_RenderFillRect( gRenderer, &fill );
+
+    gTextAtlas.render( ( SCREEN_WIDTH - gTextAtlas.getTextWidth( label ) ) / 2, frame.y + frame.h + 10, label, textColor );
+
+    //Update screen
+    SDL_RenderPresent( gRenderer );
+    LTexture::endStatsFrame();
+
+    mDirty = false;
+}
+
+GameScene::GameScene() : Scene( "game frame" )
+{
+    mThread = NULL;
+    mInputLock = NULL;
+    mWake = NULL;
+    SDL_AtomicSet( &mQuit, 0 );
+    SDL_AtomicSet( &mHeld, 0 );
+    SDL_AtomicSet( &mResumed, 0 );
+    mReplayPos = 0;
+    mLastPresent = 0;
+    mGameplayCreations = 0;
+    mGamesRecorded = 0;
+    mReplayFailed = false;
+    mAccumulator = 0;
+    mOldCounter = 0;
+    for( int phase = 0; phase < NUM_OF_PHASES; ++phase )
+    {
+        mPhaseTimes[ phase ] = 0;
+        mProfiledTimes[ phase ] = 0;
+    }
+    mFlaps = 0;
+    mFlapsShown = 0;
+    mUntimedFlaps = 0;
+    mEndShown = false;
+    mFinished = false;
+    mFinishTime = 0;
+    mPaused = false;
+    mFrameTimes.reserve( 60 * 60 * 5 );
+}
+
+GameScene::~GameScene()
+{
+    stopSimulation();
+
+    if( mWake != NULL )
+    {
+        SDL_DestroySemaphore( mWake );
+    }
+    if( mInputLock != NULL )
+    {
+        SDL_DestroyMutex( mInputLock );
+    }
+}
+
+void GameScene::enter()
+{
+    Scene::enter();
+
+    //Laid out from the clock unless replaying
+    Uint32 seed = gReplaying ? gReplay.seed : (Uint32)time(0);
+    mWorld.reset(seed, gObstacleSettings);
+
+    //Simulation phases are summed up on their own thread and handed over with the snapshots
+    for( int phase = 0; phase < NUM_OF_PHASES; ++phase )
+    {
+        mPhaseTimes[ phase ] = 0;
+        mProfiledTimes[ phase ] = 0;
+    }
+    mWorld.phaseTimes = mPhaseTimes;
+
+    mRecording.seed = seed;
+    mRecording.tickRate = gTickRate;
+    mRecording.obstacles = gObstacleSettings;
+    mRecording.collision = gCollisionSettings;
+    mRecording.inputs.clear();
+
+    mReplayPos = 0;
+    mInputs.clear();
+    mPending.clear();
+
+    mFlaps = 0;
+    mFlapsShown = 0;
+
+    mLastPresent = 0;
+    mGameStarts.push_back( mFrameTimes.size() );
+
+    mGameplayCreations = 0;
+
+    currentScore = 0;
+
+    mEndShown = false;
+    mFinished = false;
+    mPaused = false;
+
+    //The renderer starts from the layout before the first tick
+    mSnapshots.reset( gObstacleSettings.capacity );
+    mWorld.capture( mSnapshots.getBack() );
+    mSnapshots.getBack().tickTime = SDL_GetPerformanceCounter();
+    mSnapshots.getBack().flaps = 0;
+    mSnapshots.publish();
+    mSnapshots.acquire();
+
+    //Time phases from the first frame if the overlay is up
+    gProfiler.setEnabled( gShowProfiler );
+
+    mAccumulator = 0;
+    mOldCounter = SDL_GetPerformanceCounter();
+
+    SDL_AtomicSet( &mQuit, 0 );
+    SDL_AtomicSet( &mHeld, 0 );
+    SDL_AtomicSet( &mResumed, 0 );
+
+    if( mInputLock == NULL )
+    {
+        mInputLock = SDL_CreateMutex();
+    }
+    if( mWake == NULL )
+    {
+        mWake = SDL_CreateSemaphore( 0 );
+    }
+
+    //Wake-ups left over from the last game
+    while( mWake != NULL && SDL_SemTryWait( mWake ) == 0 )
+    {
+    }
+
+    //The simulation thread owns the world until the game ends or is stopped
+    if( mInputLock != NULL && mWake != NULL )
+    {
+        mThread = SDL_CreateThread( simulate, "simulation", this );
+    }
+
+    //Without it the main thread steps the world itself, once per frame
+    if( mThread == NULL )
+    {
+        printf( "Unable to start simulation thread, simulating in place! SDL Error: %s\n", SDL_GetError() );
+    }
+}
+
+SceneId GameScene::handleEvent( SDL_Event& e )
+{
+    InputAction action;
+
+    //User requests quit
+    if( e.type == SDL_QUIT )
+    {
+        stopSimulation();
+        if( gReplaying && !mFinished )
+        {
+            report();
+        }
+        return SCENE_QUIT;
+    }
+
+    //Keys pressed while the last frame is up are dropped
+    if( mFinished )
+    {
+        return SCENE_GAME;
+    }
+
+    //Toggle the performance overlay
+    if( e.type == SDL_KEYDOWN && e.key.repeat == 0 && e.key.keysym.sym == SDLK_F3 )
+    {
+        gShowProfiler = !gShowProfiler;
+        gProfiler.setEnabled( gShowProfiler );
+    }
+
+    //Queue input for the roach, replays ignore the keyboard
+    if( !gReplaying && translateInput( e, action ) )
+    {
+        //Events are stamped in milliseconds, take them back from now on the counter the simulation runs on
+        TimedInput input = { SDL_GetPerformanceCounter(), action };
+        Uint32 age = SDL_GetTicks() - e.key.timestamp;
+        if( e.key.timestamp != 0 && age <= (Uint32)gMaxCatchUpMs )
+        {
+            input.time -= (Uint64)age * SDL_GetPerformanceFrequency() / 1000;
+        }
+
+        SDL_LockMutex( mInputLock );
+        mInputs.push_back( input );
+        SDL_UnlockMutex( mInputLock );
+    }
+    return SCENE_GAME;
+}
+
+SceneId GameScene::update()
+{
+    if( mThread == NULL && !mPaused && !mWorld.ended )
+    {
+        advance();
+    }
+
+    //Pick up the newest tick, and the simulation time spent since the last one picked up
+    if( mSnapshots.acquire() )
+    {
+        const WorldSnapshot &snapshot = mSnapshots.getFront();
+        for( int phase = 0; phase < NUM_OF_PHASES; ++phase )
+        {
+            if( gProfiler.isEnabled() )
+            {
+                gProfiler.add( (ProfilePhase)phase, snapshot.phaseTimes[ phase ] - mProfiledTimes[ phase ] );
+            }
+            mProfiledTimes[ phase ] = snapshot.phaseTimes[ phase ];
+        }
+    }
+
+    if( mSnapshots.getFront().ended )
+    {
+        //Let the frame the game ended on go up first
+        if( !mEndShown )
+        {
+            mDirty = true;
+            return SCENE_GAME;
+        }
+
+        if( !mFinished )
+        {
+            finish();
+            if( gReplaying )
+            {
+                return SCENE_QUIT;
+            }
+        }
+
+        if( SDL_GetTicks() - mFinishTime < GAME_OVER_HOLD_MS )
+        {
+            return SCENE_GAME;
+        }
+
+        //Keys mashed at the end shouldn't skip the score
+        SDL_PumpEvents();
+        SDL_FlushEvent(SDL_KEYDOWN);
+        return SCENE_SCORE;
+    }
+
+    //The paused frame is already up
+    if( mPaused )
+    {
+        return SCENE_GAME;
+    }
+
+    //Interpolated frames change every time
+    mDirty = true;
+    return SCENE_GAME;
+}
+
+Uint32 GameScene::getWaitTimeout()
+{
+    //Sleep out the hold on the last frame, events still wake the loop
+    if( mFinished )
+    {
+        Uint32 held = SDL_GetTicks() - mFinishTime;
+        return held < GAME_OVER_HOLD_MS ? GAME_OVER_HOLD_MS - held : 0;
+    }
+
+    //Nothing moves until the window comes back
+    if( mPaused )
+    {
+        return IDLE_WAIT_MS;
+    }
+    return 0;
+}
+
+int GameScene::getFrameRate()
+{
+    return gPacing == PACING_LIMITER ? gFrameCap : 0;
+}
+
+void GameScene::render()
+{
+    //In-game score text
+    SDL_Color scoreColor = { 72, 45, 30, 0xFF };
+    char scoreText[30];
+
+    const WorldSnapshot &snapshot = mSnapshots.getFront();
+
+    //Frames trail the simulation by a tick, showing how far time has gone between the snapshot's last two ticks
+    float alpha = 1.0f;
+    if( !snapshot.ended )
+    {
+        Uint64 now = SDL_GetPerformanceCounter();
+        Uint64 counterPerTick = SDL_GetPerformanceFrequency() / gTickRate;
+        alpha = now > snapshot.tickTime ? std::min( (float)( now - snapshot.tickTime ) / counterPerTick, 1.0f ) : 0.0f;
+    }
+
+    //Clear screen, unless the background covers it
+    if( !gBackgroundLayers.isOpaque() )
+    {
+        SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
+        SDL_RenderClear( gRenderer );
+    }
+
+    //Render background and objects
+    renderSnapshot(snapshot, alpha);
+
+    //Render score
+    {
+        ScopedTimer timer( PHASE_HUD );
+
+        sprintf(scoreText, "Score: %d", snapshot.score);
+        gTextAtlas.render(10, 10, scoreText, scoreColor);
+
+        if( mPaused && !snapshot.ended )
+        {
+            const char* label = "Paused";
+            gTextAtlas.render( ( SCREEN_WIDTH - gTextAtlas.getTextWidth( label ) ) / 2, ( SCREEN_HEIGHT - gTextAtlas.getHeight() ) / 2, label, scoreColor );
+        }
+    }
+
+    if( gShowProfiler )
+    {
+        gProfiler.render();
+    }
+
+    //Update screen
+    {
+        ScopedTimer timer( PHASE_PRESENT );
+        SDL_RenderPresent( gRenderer );
+    }
+    LTexture::endStatsFrame();
+    mDirty = false;
+
+    Uint64 presentCounter = SDL_GetPerformanceCounter();
+
+    //The first frame drawn from a tick a flap went into is the one that shows it
+    if( gMeasureLatency )
+    {
+        for( ; mFlapsShown != snapshot.flaps; ++mFlapsShown )
+        {
+            if( snapshot.flaps - mFlapsShown > FLAP_TIME_SLOTS )
+            {
+                ++mUntimedFlaps;
+                continue;
+            }
+            mLatencies.push_back( ( presentCounter - snapshot.flapTimes[ mFlapsShown % FLAP_TIME_SLOTS ] ) * 1000.0f / SDL_GetPerformanceFrequency() );
+        }
+    }
+
+    //Redraws of the held last frame or a paused one don't count as gameplay
+    if( mFinished || mPaused )
+    {
+        return;
+    }
+
+    if( snapshot.ended )
+    {
+        mEndShown = true;
+    }
+
+    mGameplayCreations += LTexture::getFrameStats().textureCreations;
+
+    if( mLastPresent != 0 )
+    {
+        mFrameTimes.push_back( ( presentCounter - mLastPresent ) * 1000.0f / SDL_GetPerformanceFrequency() );
+        gProfiler.endFrame( presentCounter - mLastPresent );
+    }
+    mLastPresent = presentCounter;
+}
+
+void GameScene::setWindowState( bool visible, bool focused )
+{
+    //Replays take no input, only hiding the window stops them
+    bool paused = !visible || ( !focused && !gReplaying );
+    if( paused == mPaused )
+    {
+        return;
+    }
+    mPaused = paused;
+    mDirty = true;
+
+    //The simulation picks its clock up from the resume, so the time away is never simulated
+    SDL_AtomicSet( &mHeld, mPaused ? 1 : 0 );
+    if( !mPaused )
+    {
+        SDL_AtomicSet( &mResumed, 1 );
+        if( mThread == NULL )
+        {
+            mOldCounter = SDL_GetPerformanceCounter();
+        }
+
+        //Nor counted as a frame
+        mLastPresent = 0;
+    }
+    if( mThread != NULL )
+    {
+        SDL_SemPost( mWake );
+    }
+}
+
+int GameScene::simulate( void* data )
+{
+    GameScene* scene = (GameScene*)data;
+    const Uint64 counterPerTick = SDL_GetPerformanceFrequency() / gTickRate;
+
+    while( SDL_AtomicGet( &scene->mQuit ) == 0 )
+    {
+        if( SDL_AtomicSet( &scene->mResumed, 0 ) != 0 )
+        {
+            scene->mOldCounter = SDL_GetPerformanceCounter();
+        }
+
+        //Held while the window is away
+        if( SDL_AtomicGet( &scene->mHeld ) != 0 )
+        {
+            SDL_SemWait( scene->mWake );
+            continue;
+        }
+
+        if( !scene->advance() )
+        {
+            break;
+        }
+
+        //Sleep until the next tick is due, rounded up so it never spins. Quitting and pausing wake it early
+        Uint64 remaining = counterPerTick - scene->mAccumulator;
+        Uint32 ms = (Uint32)( ( remaining * 1000 + SDL_GetPerformanceFrequency() - 1 ) / SDL_GetPerformanceFrequency() );
+        SDL_SemWaitTimeout( scene->mWake, ms );
+    }
+
+    return 0;
+}
+
+bool GameScene::advance()
+{
+    //Fixed simulation step, in seconds and in performance counter units
+    const float dt = 1.0f / gTickRate;
+    const Uint64 counterPerTick = SDL_GetPerformanceFrequency() / gTickRate;
+    const Uint64 maxCatchUp = SDL_GetPerformanceFrequency() * gMaxCatchUpMs / 1000;
+
+    //Take the inputs queued by the main thread
+    SDL_LockMutex( mInputLock );
+    mPending.insert( mPending.end(), mInputs.begin(), mInputs.end() );
+    mInputs.clear();
+    SDL_UnlockMutex( mInputLock );
+
+    Uint64 currentCounter = SDL_GetPerformanceCounter();
+    Uint64 frameTime = currentCounter - mOldCounter;
+    mOldCounter = currentCounter;
+
+    //After a stall, drop the time past the budget instead of replaying it
+    if( frameTime > maxCatchUp )
+    {
+        frameTime = maxCatchUp;
+    }
+    mAccumulator += frameTime;
+
+    if( mAccumulator < counterPerTick )
+    {
+        return true;
+    }
+
+    //Step the simulation at a fixed rate regardless of the display refresh
+    {
+        TraceScope trace( "simulate" );
+
+        //Real time the next tick starts at
+        Uint64 tickStart = currentCounter - mAccumulator;
+        size_t applied = 0;
+
+        while( mAccumulator >= counterPerTick && !mWorld.ended )
+        {
+            //Inputs that happened before this tick, however many ticks this call steps
+            while( applied < mPending.size() && mPending[ applied ].time <= tickStart )
+            {
+                if( mWorld.handleInput( mPending[ applied ].action ) && mPending[ applied ].action == INPUT_FLAP_PRESS )
+                {
+                    mFlapTimes[ mFlaps % FLAP_TIME_SLOTS ] = mPending[ applied ].time;
+                    ++mFlaps;
+                }
+
+                if( !gRecordPath.empty() )
+                {
+                    ScriptedInput input = { mWorld.tick, mPending[ applied ].action };
+                    mRecording.inputs.push_back( input );
+                }
+                ++applied;
+            }
+
+            //Feed replayed inputs at the ticks they were recorded at
+            while( gReplaying && mReplayPos < gReplay.inputs.size() && gReplay.inputs[ mReplayPos ].tick <= mWorld.tick )
+            {
+                mWorld.handleInput( gReplay.inputs[ mReplayPos ].action );
+                ++mReplayPos;
+            }
+
+            mWorld.step(dt);
+            mAccumulator -= counterPerTick;
+            tickStart += counterPerTick;
+        }
+
+        //The rest wait for the tick after them
+        mPending.erase( mPending.begin(), mPending.begin() + applied );
+    }
+
+    //Hand the latest tick to the renderer, stamped with when it was due
+    WorldSnapshot &snapshot = mSnapshots.getBack();
+    mWorld.capture( snapshot );
+    snapshot.tickTime = currentCounter - mAccumulator;
+    snapshot.flaps = mFlaps;
+    memcpy( snapshot.flapTimes, mFlapTimes, sizeof( mFlapTimes ) );
+    mSnapshots.publish();
+
+    return !mWorld.ended;
+}
+
+void GameScene::stopSimulation()
+{
+    if( mThread != NULL )
+    {
+        SDL_AtomicSet( &mQuit, 1 );
+        SDL_SemPost( mWake );
+        SDL_WaitThread( mThread, NULL );
+        mThread = NULL;
+    }
+}
+
+void GameScene::finish()
+{
+    //The world is the main thread's again
+    stopSimulation();
+
+    mFinished = true;
+    mFinishTime = SDL_GetTicks();
+
+    currentScore = mWorld.score;
+
+    if( !gRecordPath.empty() )
+    {
+        mRecording.finalTick = mWorld.tick;
+        mRecording.finalScore = mWorld.score;
+
+        //The first game goes to the path given, later ones get their number before the extension
+        std::string path = gRecordPath;
+        if( ++mGamesRecorded > 1 )
+        {
+            size_t slash = path.find_last_of( "/\\" );
+            size_t dot = path.find_last_of( '.' );
+            if( dot == std::string::npos || dot == 0 || ( slash != std::string::npos && dot <= slash + 1 ) )
+            {
+                dot = path.size();
+            }
+
+            char number[ 16 ];
+            sprintf( number, "-%u", mGamesRecorded );
+            path.insert( dot, number );
+        }
+        saveRecording( path, mRecording );
+    }
+
+    //A replay is a benchmark run, keep it away from the high score
+    if( gReplaying )
+    {
+        if( mWorld.tick != gReplay.finalTick || mWorld.score != gReplay.finalScore )
+        {
+            printf( "Replay diverged: ended at tick %u with score %u, recorded tick %u with score %u\n", mWorld.tick, mWorld.score, gReplay.finalTick, gReplay.finalScore );
+            mReplayFailed = true;
+        }
+        if( !report() )
+        {
+            mReplayFailed = true;
+        }
+        return;
+    }
+
+    TraceScope gameOver( "game over" );
+
+    evaluateScore();
+}
+
+bool GameScene::report()
+{
+    //Sorted on a copy, the pacing report wants them in order
+    std::vector<float> frameTimes( mFrameTimes );
+    reportFrameTimes( frameTimes );
+    printf( "Texture creations during gameplay: %u\n", mGameplayCreations );
+
+    //Everything is uploaded while loading, a texture made mid-game is a stall
+    if( mGameplayCreations > 0 )
+    {
+        printf( "Replay created textures during gameplay!\n" );
+        return false;
+    }
+    return true;
+}
+
+bool GameScene::hasReplayFailed()
+{
+    return mReplayFailed;
+}
+
+void GameScene::reportPacing()
+{
+    ::reportPacing( mFrameTimes, mGameStarts );
+}
+
+void GameScene::reportLatency()
+{
+    if( mLatencies.empty() )
+    {
+        printf( "No flaps presented\n" );
+        return;
+    }
+
+    std::sort( mLatencies.begin(), mLatencies.end() );
+
+    double sum = 0.0;
+    for( size_t i = 0; i < mLatencies.size(); ++i )
+    {
+        sum += mLatencies[ i ];
+    }
+
+    char pacing[ 40 ];
+    describePacing( pacing );
+
+    size_t count = mLatencies.size();
+    printf( "Input to present latency (%s, %d Hz ticks) over %u flaps: mean %.2f ms, p50 %.2f ms, p99 %.2f ms, worst %.2f ms\n",
+            pacing, gTickRate, (unsigned)count, sum / count, mLatencies[ count / 2 ], mLatencies[ count * 99 / 100 ], mLatencies[ count - 1 ] );
+
+    if( mUntimedFlaps > 0 )
+    {
+        printf( "%u more flaps went up too many to a frame to be timed\n", mUntimedFlaps );
+    }
+}
+
+ScoreScene::ScoreScene( bool isHighScore ) : Scene( "score frame" )
+{
+    mIsHighScore = isHighScore;
+    mScore[ 0 ] = '\0';
+    mStanding[ 0 ] = '\0';
+    mMessage = "";
+}
+
+void ScoreScene::enter()
+{
+    Scene::enter();
+
+    //Ranks come from the index, the score history file is never scanned
+    if (!mIsHighScore)
+    {
+        sprintf(mScore, "Your score: %d", currentScore);
+        sprintf(mStanding, "Rank #%u of %u, better than %.1f%%", gScoreHistory.getRank(currentScore), gScoreHistory.getCount(), gScoreHistory.getPercentile(currentScore));
+        mMessage = "Press [SPACE] to restart or [ESC] to exit.";
+    }
+    else
+    {
+        sprintf(mScore, "High Score: %u", gScoreHistory.getBest());
+        sprintf(mStanding, "%u runs played", gScoreHistory.getCount());
+        mMessage = "Press [ESC] to exit.";
+    }
+}
+
+SceneId ScoreScene::handleEvent( SDL_Event& e )
+{
+    switch(e.type) {
+    case SDL_QUIT:
+        return SCENE_QUIT;
+    case SDL_KEYDOWN:
+        if(e.key.keysym.sym == SDLK_ESCAPE)
+        {
+            return SCENE_MENU;
+        }
+        if(e.key.keysym.sym == SDLK_SPACE && !mIsHighScore)
+        {
+            return SCENE_GAME;
+        }
+    }
+    return mIsHighScore ? SCENE_HIGH_SCORE : SCENE_SCORE;
+}
+
+SceneId ScoreScene::update()
+{
+    return mIsHighScore ? SCENE_HIGH_SCORE : SCENE_SCORE;
+}
+
+void ScoreScene::render()
+{
+    SDL_Color color = {250, 202, 10, 0xFF};
+
+    //Clear screen
+    SDL_SetRenderDrawColor( gRenderer, 0, 0, 0, 0x0 );
+    SDL_RenderClear( gRenderer );
+
+    gTextAtlas.render((SCREEN_WIDTH - gTextAtlas.getTextWidth(mScore)) / 2, (SCREEN_HEIGHT - gTextAtlas.getHeight()) / 2, mScore, color);
+    gTextAtlas.render((SCREEN_WIDTH - gTextAtlas.getTextWidth(mStanding)) / 2, (SCREEN_HEIGHT - gTextAtlas.getHeight()) / 2 + gTextAtlas.getHeight() + 10, mStanding, color);
+    gTextAtlas.render((SCREEN_WIDTH - gTextAtlas.getTextWidth(mMessage)) / 2, (SCREEN_HEIGHT - gTextAtlas.getHeight()) / 2 + gTextAtlas.getHeight() + 50, mMessage, color);
+
+    //Update screen
+    SDL_RenderPresent( gRenderer );
+    LTexture::endStatsFrame();
+
+    mDirty = false;
+}
+
+bool runScenes( SceneId first )
+{
+    MenuScene menu;
+    LoadingScene loading;
+    GameScene game;
+    ScoreScene score( false );
+    ScoreScene highScore( true );
+    Scene* scenes[ NUM_OF_SCENES ] = { &menu, &loading, &game, &score, &highScore };
+
+    //Whether the window can be seen and has the keyboard
+    Uint32 flags = SDL_GetWindowFlags( gWindow );
+    bool visible = !( flags & ( SDL_WINDOW_HIDDEN | SDL_WINDOW_MINIMIZED ) );
+    bool focused = ( flags & SDL_WINDOW_INPUT_FOCUS ) != 0;
+
+    SceneId current = first;
+    scenes[ current ]->enter();
+    scenes[ current ]->setWindowState( visible, focused );
+
+    //Performance counter value the next frame is due at, zero lets a new scene draw at once
+    Uint64 nextFrame = 0;
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+
+    SDL_Event e;
+
+    while( current != SCENE_QUIT )
+    {
+        Scene* scene = scenes[ current ];
+
+        //Sleep until an event, the scene's next deadline or its next frame slot.
+        //A hidden window has nothing to show, so it blocks until the window manager wakes it
+        Uint32 timeout;
+        if( !visible )
+        {
+            timeout = 0;
+        }
+        else if( scene->needsRender() )
+        {
+            //Wake a little early, the render below spins out the rest precisely
+            Uint64 now = SDL_GetPerformanceCounter();
+            Uint32 untilFrame = nextFrame > now ? (Uint32)( ( nextFrame - now ) * 1000 / frequency ) : 0;
+            timeout = untilFrame > SPIN_MARGIN_MS ? untilFrame - SPIN_MARGIN_MS : 0;
+        }
+        else
+        {
+            timeout = scene->getWaitTimeout();
+        }
+
+        bool hasEvent;
+        if( !visible )
+        {
+            hasEvent = SDL_WaitEvent( &e ) != 0;
+        }
+        else if( timeout > 0 )
+        {
+            hasEvent = SDL_WaitEventTimeout( &e, timeout ) != 0;
+        }
+        else
+        {
+            hasEvent = SDL_PollEvent( &e ) != 0;
+        }
+
+        TraceScope trace( scene->getName() );
+
+        //Handle events on queue, the rest wait for the next scene once this one switches
+        SceneId next = current;
+        {
+            ScopedTimer timer( PHASE_EVENTS );
+
+            while( hasEvent )
+            {
+                if( e.type == SDL_WINDOWEVENT )
+                {
+                    switch( e.window.event )
+                    {
+                    case SDL_WINDOWEVENT_HIDDEN:
+                    case SDL_WINDOWEVENT_MINIMIZED:
+                        visible = false;
+                        break;
+                    case SDL_WINDOWEVENT_SHOWN:
+                    case SDL_WINDOWEVENT_RESTORED:
+                    case SDL_WINDOWEVENT_MAXIMIZED:
+                    case SDL_WINDOWEVENT_EXPOSED:
+                        visible = true;
+                        scene->invalidate();
+                        break;
+                    case SDL_WINDOWEVENT_SIZE_CHANGED:
+                        scene->invalidate();
+                        break;
+                    case SDL_WINDOWEVENT_FOCUS_GAINED:
+                        focused = true;
+                        break;
+                    case SDL_WINDOWEVENT_FOCUS_LOST:
+                        focused = false;
+                        break;
+                    }
+                    scene->setWindowState( visible, focused );
+                }
+
+                //Target textures lost their contents, the backbuffer with them
+                if( e.type == SDL_RENDER_TARGETS_RESET )
+                {
+                    gBackgroundLayers.invalidate();
+                    scene->invalidate();
+                }
+
+                next = scene->handleEvent( e );
+                if( next != current )
+                {
+                    break;
+                }
+                hasEvent = SDL_PollEvent( &e ) != 0;
+            }
+        }
+
+        //Scenes stand still while hidden, the asset loader catches up on return
+        if( next == current && visible )
+        {
+            next = scene->update();
+        }
+
+        if( next != current )
+        {
+            current = next;
+            if( current != SCENE_QUIT )
+            {
+                scenes[ current ]->enter();
+                scenes[ current ]->setWindowState( visible, focused );
+            }
+            nextFrame = 0;
+            continue;
+        }
+
+        //Draw only what changed, and no faster than the scene's frame rate
+        if( visible && scene->needsRender() )
+        {
+            Uint64 now = SDL_GetPerformanceCounter();
+
+            //An event woke the loop well before the frame is due
+            if( nextFrame > now && ( nextFrame - now ) * 1000 / frequency >= SPIN_MARGIN_MS )
+            {
+                continue;
+            }
+
+            while( now < nextFrame )
+            {
+                now = SDL_GetPerformanceCounter();
+            }
+
+            scene->render();
+
+            //Frames keep to a fixed grid, unless one came in a whole frame late
+            int rate = scene->getFrameRate();
+            if( rate > 0 )
+            {
+                Uint64 interval = frequency / rate;
+                nextFrame = nextFrame != 0 && now - nextFrame < interval ? nextFrame + interval : now + interval;
+            }
+            else
+            {
+                nextFrame = 0;
+            }
+        }
+    }
+
+    if( gMeasureLatency )
+    {
+        game.reportLatency();
+    }
+
+    if( gReportPacing )
+    {
+        game.reportPacing();
+    }
+
+    return !game.hasReplayFailed();
+}
+
+void evaluateScore()
+{
+    TraceScope trace( "evaluateScore" );
+
+    //Saved in the background, the frame never waits on the disk
+    gScoreHistory.submit(currentScore);
+}
+
+void calculateScore(World &world)
+{
+    //Simulated milliseconds before and after this tick
+    Uint64 elapsed = (Uint64)world.tick * 1000 / gTickRate;
+    Uint64 prevElapsed = (Uint64)(world.tick - 1) * 1000 / gTickRate;
+
+    //5 points for every 100ms survived past the first 3 seconds
+    if (elapsed / 100 != prevElapsed / 100 && elapsed >= 3000)
+    {
+        world.score += 5;
+    }
+}
+
+bool loadInputScript( std::string path, std::vector<ScriptedInput>& script )
+{
+    std::ifstream file( path.c_str() );
+    if( !file.good() )
+    {
+        printf( "Unable to open input script %s!\n", path.c_str() );
+        return false;
+    }
+
+    script.clear();
+
+    std::string line;
+    int lineNumber = 0;
+    while( std::getline( file, line ) )
+    {
+        ++lineNumber;
+
+        //Skip blank lines and comments
+        if( line.empty() || line[ 0 ] == '#' )
+        {
+            continue;
+        }
+
+        std::istringstream fields( line );
+        ScriptedInput input;
+        std::string action;
+        if( !( fields >> input.tick >> action ) || ( action != "press" && action != "release" ) )
+        {
+            printf( "Bad input script line %d in %s!\n", lineNumber, path.c_str() );
+            return false;
+        }
+        input.action = action == "press" ? INPUT_FLAP_PRESS : INPUT_FLAP_RELEASE;
+
+        if( !script.empty() && input.tick < script.back().tick )
+        {
+            printf( "Input script %s is not in tick order at line %d!\n", path.c_str(), lineNumber );
+            return false;
+        }
+
+        script.push_back( input );
+    }
+
+    return true;
+}
+
+//Work and results of one benchmark thread
+struct BenchWorker
+{
+    int index;
+    SDL_Thread* thread;
+
+    //Set to stop every worker early, shared by all of them
+    SDL_atomic_t* stop;
+
+    Uint32 ticks;
+    Uint64 elapsed;
+    Uint32 games;
+    Uint64 totalScore;
+
+    //Set when a replayed game ends differently than recorded
+    bool diverged;
+};
+
+int benchWorker( void* data )
+{
+    BenchWorker* worker = (BenchWorker*)data;
+
+    const float dt = 1.0f / gTickRate;
+
+    //Random flaps average three a second and last a tenth of a second
+    Random inputRng( gBenchSeed ^ ( 0x85EBCA6Bu * ( worker->index + 1 ) ) );
+    int flapChance = gTickRate / 3 > 1 ? gTickRate / 3 : 1;
+    int flapTicks = gTickRate / 10 > 1 ? gTickRate / 10 : 1;
+    Uint32 releaseTick = 0;
+    bool flapping = false;
+
+    //Position in the input script for the current game
+    size_t scriptPos = 0;
+
+    //Replays always lay out the recorded game
+    World world;
+    Uint32 seed = gReplaying ? gReplay.seed : gBenchSeed + worker->index * 7919;
+    world.reset( seed, gObstacleSettings );
+
+    worker->ticks = 0;
+    worker->games = 1;
+    worker->totalScore = 0;
+    worker->diverged = false;
+
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    while( worker->ticks < gBenchTicks )
+    {
+        //Checked now and then, to keep it out of the timing
+        if( ( worker->ticks & 1023 ) == 0 && SDL_AtomicGet( worker->stop ) != 0 )
+        {
+            break;
+        }
+
+        //Feed this tick's input
+        if( !gInputScript.empty() )
+        {
+            while( scriptPos < gInputScript.size() && gInputScript[ scriptPos ].tick <= world.tick )
+            {
+                world.handleInput( gInputScript[ scriptPos ].action );
+                ++scriptPos;
+            }
+        }
+        else if( flapping && world.tick >= releaseTick )
+        {
+            world.handleInput( INPUT_FLAP_RELEASE );
+            flapping = false;
+        }
+        else if( !flapping && inputRng.range( flapChance ) == 0 )
+        {
+            world.handleInput( INPUT_FLAP_PRESS );
+            flapping = true;
+            releaseTick = world.tick + flapTicks;
+        }
+
+        world.step( dt );
+        ++worker->ticks;
+
+        //Start over with a new layout after a crash
+        if( world.ended )
+        {
+            if( gReplaying && ( world.tick != gReplay.finalTick || world.score != gReplay.finalScore ) )
+            {
+                worker->diverged = true;
+            }
+
+            worker->totalScore += world.score;
+            ++worker->games;
+
+            world.reset( gReplaying ? seed : ++seed, gObstacleSettings );
+            scriptPos = 0;
+            flapping = false;
+        }
+    }
+
+    worker->elapsed = SDL_GetPerformanceCounter() - start;
+    worker->totalScore += world.score;
+
+    return 0;
+}
+
+int runHeadless()
+{
+    int numThreads = gBenchThreads > 0 ? gBenchThreads : SDL_GetCPUCount();
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    //Replays drive the worlds like a script
+    if( gReplaying )
+    {
+        gInputScript = gReplay.inputs;
+    }
+
+    printf( "Headless benchmark: %d thread(s) x %u ticks at %d Hz, %d obstacle slot(s) %dpx apart at %d%% density, %s collision on %d hitbox(es)%s, %s input\n", numThreads, gBenchTicks, gTickRate, gObstacleSettings.capacity, gObstacleSettings.spacing, gObstacleSettings.density, ColliderStore::getKernelName(), gCollisionSettings.hitboxes, gCollisionSettings.boxesOnly ? "" : " and masks", gReplaying ? "replayed" : gInputScript.empty() ? "random" : "scripted" );
+
+    SDL_atomic_t stop;
+    SDL_AtomicSet( &stop, 0 );
+
+    std::vector<BenchWorker> workers( numThreads );
+    for( int i = 0; i < numThreads; ++i )
+    {
+        workers[ i ].index = i;
+        workers[ i ].stop = &stop;
+        workers[ i ].thread = SDL_CreateThread( benchWorker, "bench", &workers[ i ] );
+        if( workers[ i ].thread == NULL )
+        {
+            printf( "Unable to create benchmark thread! SDL Error: %s\n", SDL_GetError() );
+
+            //The started workers write into the vector, let them finish before it goes
+            SDL_AtomicSet( &stop, 1 );
+            for( int started = 0; started < i; ++started )
+            {
+                SDL_WaitThread( workers[ started ].thread, NULL );
+            }
+            return 1;
+        }
+    }
+
+    double totalRate = 0.0;
+    bool diverged = false;
+    for( int i = 0; i < numThreads; ++i )
+    {
+        SDL_WaitThread( workers[ i ].thread, NULL );
+
+        double seconds = workers[ i ].elapsed / frequency;
+        double rate = workers[ i ].ticks / seconds;
+        totalRate += rate;
+
+        printf( "  thread %d: %.3f s, %.0f ticks/s (%.0fx real time), %u games, avg score %.1f\n", i, seconds, rate, rate / gTickRate, workers[ i ].games, (double)workers[ i ].totalScore / workers[ i ].games );
+
+        if( workers[ i ].diverged )
+        {
+            printf( "  thread %d: replay diverged from the recorded outcome!\n", i );
+            diverged = true;
+        }
+    }
+
+    printf( "Total: %.0f ticks/s, %.0f ticks/s per thread\n", totalRate, totalRate / numThreads );
+
+    //Scripted replays check the exit code
+    return diverged ? 1 : 0;
+}
+
+//Recordings are little-endian: "CRRP", version, tick rate, seed, varints of the
+//obstacle capacity, spacing and density (from version 3), of the hitbox budget and
+//whether collision stops at the boxes (from version 4), input count, then per
+//input a varint of (tick delta << 1 | action), then final tick and score
+const char RECORDING_MAGIC[ 4 ] = { 'C', 'R', 'R', 'P' };
+const Uint8 RECORDING_VERSION = 4;
+
+//Oldest recording laid out and collided the same way
+const Uint8 MIN_RECORDING_VERSION = 4;
+
+void writeUint32( std::vector<Uint8>& out, Uint32 value )
+{
+    for( int i = 0; i < 4; ++i )
+    {
+        out.push_back( ( value >> ( i * 8 ) ) & 0xFF );
+    }
+}
+
+void writeVarint( std::vector<Uint8>& out, Uint32 value )
+{
+    while( value >= 0x80 )
+    {
+        out.push_back( ( value & 0x7F ) | 0x80 );
+        value >>= 7;
+    }
+    out.push_back( value );
+}
+
+bool readUint32( const std::vector<Uint8>& in, size_t& pos, Uint32& value )
+{
+    if( pos + 4 > in.size() )
+    {
+        return false;
+    }
+
+    value = 0;
+    for( int i = 0; i < 4; ++i )
+    {
+        value |= (Uint32)in[ pos++ ] << ( i * 8 );
+    }
+    return true;
+}
+
+bool readVarint( const std::vector<Uint8>& in, size_t& pos, Uint32& value )
+{
+    value = 0;
+    for( int shift = 0; shift < 35; shift += 7 )
+    {
+        if( pos >= in.size() )
+        {
+            return false;
+        }
 
-        if (endGame)
+        Uint8 byte = in[ pos++ ];
+        value |= (Uint32)( byte & 0x7F ) << shift;
+        if( ( byte & 0x80 ) == 0 )
         {
-            evaluateScore();
-            SDL_Delay(2000);
-            SDL_PumpEvents();
-            SDL_FlushEvent(SDL_KEYDOWN);
-            return;
+            return true;
         }
     }
+    return false;
 }
 
-int showScore(bool isHighScore)
+bool saveRecording( std::string path, const Recording& recording )
 {
-    SDL_Event e;
-    char c[30];
-    SDL_Color color = {250, 202, 10};
+    std::vector<Uint8> data;
+    data.insert( data.end(), RECORDING_MAGIC, RECORDING_MAGIC + 4 );
+    data.push_back( RECORDING_VERSION );
+    writeUint32( data, recording.tickRate );
+    writeUint32( data, recording.seed );
+    writeVarint( data, recording.obstacles.capacity );
+    writeVarint( data, recording.obstacles.spacing );
+    writeVarint( data, recording.obstacles.density );
+    writeVarint( data, recording.collision.hitboxes );
+    writeVarint( data, recording.collision.boxesOnly ? 1 : 0 );
+    writeVarint( data, recording.inputs.size() );
+
+    Uint32 lastTick = 0;
+    for( size_t i = 0; i < recording.inputs.size(); ++i )
+    {
+        writeVarint( data, ( ( recording.inputs[ i ].tick - lastTick ) << 1 ) | ( recording.inputs[ i ].action == INPUT_FLAP_RELEASE ? 1 : 0 ) );
+        lastTick = recording.inputs[ i ].tick;
+    }
+
+    writeUint32( data, recording.finalTick );
+    writeUint32( data, recording.finalScore );
+
+    std::ofstream file( path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+    if( !file.good() )
+    {
+        printf( "Unable to write recording %s!\n", path.c_str() );
+        return false;
+    }
+
+    file.write( (const char*)&data[ 0 ], data.size() );
+    return file.good();
+}
+
+bool loadRecording( std::string path, Recording& recording )
+{
+    std::ifstream file( path.c_str(), std::ios::in | std::ios::binary );
+    if( !file.good() )
+    {
+        printf( "Unable to open recording %s!\n", path.c_str() );
+        return false;
+    }
+
+    std::vector<Uint8> data( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+
+    size_t pos = 5;
+    Uint32 tickRate;
+    Uint32 capacity;
+    Uint32 spacing;
+    Uint32 density;
+    Uint32 hitboxes;
+    Uint32 boxesOnly;
+    Uint32 count;
+    if( data.size() < pos || memcmp( &data[ 0 ], RECORDING_MAGIC, 4 ) != 0 || data[ 4 ] < 1 || data[ 4 ] > RECORDING_VERSION )
+    {
+        printf( "%s is not a recording!\n", path.c_str() );
+        return false;
+    }
+
+    //Older layouts and collisions can't be reproduced
+    if( data[ 4 ] < MIN_RECORDING_VERSION )
+    {
+        printf( "Recording %s predates the obstacle generator or generated hitboxes!\n", path.c_str() );
+        return false;
+    }
 
-    while(1)
+    if( !readUint32( data, pos, tickRate ) || !readUint32( data, pos, recording.seed ) ||
+        !readVarint( data, pos, capacity ) || !readVarint( data, pos, spacing ) || !readVarint( data, pos, density ) ||
+        !readVarint( data, pos, hitboxes ) || !readVarint( data, pos, boxesOnly ) || !readVarint( data, pos, count ) )
+    {
+        printf( "%s is not a recording!\n", path.c_str() );
+        return false;
+    }
+    recording.tickRate = tickRate;
+    recording.obstacles.capacity = capacity;
+    recording.obstacles.spacing = spacing;
+    recording.obstacles.density = density;
+    recording.collision.hitboxes = hitboxes;
+    recording.collision.boxesOnly = boxesOnly != 0;
+
+    recording.inputs.clear();
+    Uint32 tick = 0;
+    for( Uint32 i = 0; i < count; ++i )
     {
-        while(SDL_PollEvent(&e))
+        Uint32 packed;
+        if( !readVarint( data, pos, packed ) )
         {
-            switch(e.type) {
-            case SDL_QUIT:
-                return 0;
-            case SDL_KEYDOWN:
-                if(e.key.keysym.sym == SDLK_ESCAPE)
-                {
-                    return 0;
-                }
-                if(e.key.keysym.sym == SDLK_SPACE && !isHighScore)
-                {
-                    return 99; //magic #
-                }
-            }
+            printf( "Recording %s is truncated!\n", path.c_str() );
+            return false;
+        }
+
+        tick += packed >> 1;
+        ScriptedInput input = { tick, ( packed & 1 ) ? INPUT_FLAP_RELEASE : INPUT_FLAP_PRESS };
+        recording.inputs.push_back( input );
+    }
+
+    if( !readUint32( data, pos, recording.finalTick ) || !readUint32( data, pos, recording.finalScore ) )
+    {
+        printf( "Recording %s is truncated!\n", path.c_str() );
+        return false;
+    }
+
+    return true;
+}
+
+int writeAssetPack()
+{
+    //Decoding needs SDL_image but no window
+    if( SDL_Init( 0 ) < 0 || !( IMG_Init( IMG_INIT_PNG ) & IMG_INIT_PNG ) )
+    {
+        printf( "SDL_image could not initialize! SDL_image Error: %s\n", IMG_GetError() );
+        return 1;
+    }
+
+    std::vector<Uint8> data( ASSET_PACK_HEADER_SIZE, 0 );
+    memcpy( &data[ 0 ], ASSET_PACK_MAGIC, 4 );
+    data[ 4 ] = ASSET_PACK_VERSION;
+
+    std::vector<Uint8> header;
+    writeUint32( header, SDL_BYTEORDER );
+    writeUint32( header, NUM_OF_SPRITES );
+    writeUint32( header, 0 );
+    writeUint32( header, 0 );
+
+    bool success = true;
+    for( int i = 0; i < NUM_OF_SPRITES && success; ++i )
+    {
+        SDL_Surface* loadedSurface = loadSurface( SPRITE_PATHS[ i ] );
+        if( loadedSurface == NULL )
+        {
+            success = false;
+            break;
         }
 
-        if (!isHighScore)
+        //Converting to a format with alpha turns the color key transparent
+        SDL_Surface* converted = SDL_ConvertSurfaceFormat( loadedSurface, SDL_PIXELFORMAT_ARGB8888, 0 );
+        SDL_FreeSurface( loadedSurface );
+        if( converted == NULL )
         {
-            sprintf(c, "Your score: %d", currentScore);
-            if( !gScoreTexture.loadFromRenderedText(c, color) )
-            {
-                printf( "Unable to render score texture!\n" );
-            }
+            printf( "Unable to convert %s! SDL Error: %s\n", SPRITE_PATHS[ i ], SDL_GetError() );
+            success = false;
+            break;
+        }
 
-            if( !gGenericTexture.loadFromRenderedText("Press [SPACE] to restart or [ESC] to exit.", color) )
-            {
-                printf( "Unable to render message texture!\n" );
-            }
+        data.resize( ( data.size() + ASSET_PACK_ALIGNMENT - 1 ) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT, 0 );
+        writeUint32( header, converted->w );
+        writeUint32( header, converted->h );
+        writeUint32( header, data.size() );
+
+        //Drop any row padding so the archive pitch is always width * 4
+        SDL_LockSurface( converted );
+        for( int y = 0; y < converted->h; ++y )
+        {
+            const Uint8* row = (const Uint8*)converted->pixels + y * converted->pitch;
+            data.insert( data.end(), row, row + converted->w * 4 );
+        }
+        SDL_UnlockSurface( converted );
+
+        printf( "Packed %s (%dx%d)\n", SPRITE_PATHS[ i ], converted->w, converted->h );
+        SDL_FreeSurface( converted );
+    }
+
+    if( success )
+    {
+        std::ifstream font( FONT_PATH, std::ios::in | std::ios::binary );
+        if( !font.good() )
+        {
+            printf( "Unable to open font %s!\n", FONT_PATH );
+            success = false;
         }
         else
         {
-            fstream file;
-            char s[20];
+            std::vector<Uint8> fontData( ( std::istreambuf_iterator<char>( font ) ), std::istreambuf_iterator<char>() );
+            data.resize( ( data.size() + ASSET_PACK_ALIGNMENT - 1 ) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT, 0 );
 
-            //Check high score from the file
-            file.open("hs.hs", fstream::in);
-            if (file.good())
-            {
-                file>>s;
-                sprintf(s, "%d", atoi(s));
-            }
-            else
-            {
-                sprintf(s, "0");
-            }
+            std::vector<Uint8> fontEntry;
+            writeUint32( fontEntry, data.size() );
+            writeUint32( fontEntry, fontData.size() );
+            std::copy( fontEntry.begin(), fontEntry.end(), header.begin() + 8 );
 
-            if (file.is_open())
-            {
-               file.close();
-            }
+            data.insert( data.end(), fontData.begin(), fontData.end() );
+            printf( "Packed %s (%u bytes)\n", FONT_PATH, (unsigned)fontData.size() );
+        }
+    }
 
-            sprintf(c, "High Score: %s", s);
-            if( !gScoreTexture.loadFromRenderedText(c, color) )
-            {
-                printf( "Unable to render score texture!\n" );
-            }
+    //Stamp the sources so the game notices art changed after packing
+    for( int i = 0; i < NUM_OF_ASSET_SOURCES && success; ++i )
+    {
+        Uint32 size;
+        Uint64 modified;
+        if( !statAssetSource( getAssetSourcePath( i ), size, modified ) )
+        {
+            printf( "Unable to stat %s!\n", getAssetSourcePath( i ) );
+            success = false;
+            break;
+        }
+        writeUint32( header, size );
+        writeUint32( header, (Uint32)modified );
+        writeUint32( header, (Uint32)( modified >> 32 ) );
+    }
 
-            if( !gGenericTexture.loadFromRenderedText("Press [ESC] to exit.", color) )
-            {
-                printf( "Unable to render message texture!\n" );
-            }
+    if( success )
+    {
+        std::copy( header.begin(), header.end(), data.begin() + 8 );
+
+        std::ofstream file( ASSET_PACK_PATH, std::ios::out | std::ios::binary | std::ios::trunc );
+        file.write( (const char*)&data[ 0 ], data.size() );
+        if( !file.good() )
+        {
+            printf( "Unable to write asset archive %s!\n", ASSET_PACK_PATH );
+            success = false;
+        }
+        else
+        {
+            printf( "Wrote %s (%u bytes)\n", ASSET_PACK_PATH, (unsigned)data.size() );
         }
+    }
 
-        //Clear screen
-        SDL_SetRenderDrawColor( gRenderer, 0, 0, 0, 0x0 );
-        SDL_RenderClear( gRenderer );
+    IMG_Quit();
+    SDL_Quit();
 
-        gScoreTexture.render((SCREEN_WIDTH - gScoreTexture.getWidth()) / 2, (SCREEN_HEIGHT - gScoreTexture.getHeight()) / 2);
-        gGenericTexture.render((SCREEN_WIDTH - gGenericTexture.getWidth()) / 2, (SCREEN_HEIGHT - gScoreTexture.getHeight()) / 2 + gGenericTexture.getHeight() + 50);
+    return success ? 0 : 1;
+}
 
-        //Update screen
-        SDL_RenderPresent( gRenderer );
+void reportFrameTimes( std::vector<float>& frameTimes )
+{
+    if( frameTimes.empty() )
+    {
+        printf( "No frames presented\n" );
+        return;
     }
-    return 0;
+
+    std::sort( frameTimes.begin(), frameTimes.end() );
+
+    double sum = 0.0;
+    for( size_t i = 0; i < frameTimes.size(); ++i )
+    {
+        sum += frameTimes[ i ];
+    }
+
+    size_t count = frameTimes.size();
+    printf( "Frame times over %u frames: mean %.2f ms, p50 %.2f ms, p99 %.2f ms, worst %.2f ms\n",
+            (unsigned)count, sum / count, frameTimes[ count / 2 ], frameTimes[ count * 99 / 100 ], frameTimes[ count - 1 ] );
 }
 
-void evaluateScore()
+void reportPacing( std::vector<float>& frameTimes, const std::vector<size_t>& gameStarts )
 {
-    fstream file;
-    Uint32 highScore = 1;
-    char s[20];
+    char pacing[ 40 ];
+    describePacing( pacing );
+
+    if( frameTimes.size() < 2 )
+    {
+        printf( "Too few frames presented (%s)\n", pacing );
+        return;
+    }
 
-    //Check high score first from the file
-    file.open("hs.hs", fstream::in);
-    if (file.good())
+    //Spread around the mean, and the change from one frame to the next the eye catches as stutter
+    double sum = 0.0;
+    double change = 0.0;
+    double worstChange = 0.0;
+    size_t changes = 0;
+    size_t nextGame = 0;
+    for( size_t i = 0; i < frameTimes.size(); ++i )
     {
-        file>>s;
-        highScore = atoi(s);
+        sum += frameTimes[ i ];
 
-        if (highScore >= 0 && currentScore > highScore)
+        //The first frame of a game follows the last of the one before, not a frame of its own
+        bool gameStart = false;
+        while( nextGame < gameStarts.size() && gameStarts[ nextGame ] <= i )
         {
-            highScore = currentScore;
+            gameStart = gameStart || gameStarts[ nextGame ] == i;
+            ++nextGame;
         }
-        else if (currentScore < highScore)
+
+        if( i > 0 && !gameStart )
         {
-            //magic #
-            highScore = 1;
+            double delta = fabs( frameTimes[ i ] - frameTimes[ i - 1 ] );
+            change += delta;
+            worstChange = std::max( worstChange, delta );
+            ++changes;
         }
     }
+
+    size_t count = frameTimes.size();
+    double mean = sum / count;
+    double variance = 0.0;
+    for( size_t i = 0; i < count; ++i )
+    {
+        variance += ( frameTimes[ i ] - mean ) * ( frameTimes[ i ] - mean );
+    }
+
+    printf( "Frame pacing (%s) over %u frames: jitter %.2f ms standard deviation, frame to frame change mean %.2f ms, worst %.2f ms\n",
+            pacing, (unsigned)count, sqrt( variance / count ), changes > 0 ? change / changes : 0.0, worstChange );
+    reportFrameTimes( frameTimes );
+}
+
+void describePacing( char* text )
+{
+    if( gPacing == PACING_LIMITER )
+    {
+        sprintf( text, "limiter at %d fps", gFrameCap );
+    }
     else
     {
-        highScore = (currentScore != 0) ? currentScore : 0;
+        sprintf( text, "%s pacing", PACING_NAMES[ gPacing ] );
+    }
+}
+
+void resolvePacing()
+{
+    SDL_RendererInfo info;
+    if( SDL_GetRendererInfo( gRenderer, &info ) != 0 )
+    {
+        printf( "Warning: Renderer info unavailable, assuming the pacing asked for! SDL Error: %s\n", SDL_GetError() );
+        info.name = "unknown";
+        info.flags = SDL_RENDERER_PRESENTVSYNC;
+    }
+
+    //Adaptive vsync is a swap interval of -1, which only the OpenGL renderers let through
+    if( gPacing == PACING_ADAPTIVE && ( strncmp( info.name, "opengl", 6 ) != 0 || SDL_GL_SetSwapInterval( -1 ) != 0 ) )
+    {
+        printf( "Warning: Adaptive vsync not supported by the %s renderer, using vsync!\n", info.name );
+        gPacing = PACING_VSYNC;
     }
 
-    if (file.is_open())
+    //Drivers may ignore the vsync request, the limiter keeps frames to the refresh instead
+    if( ( gPacing == PACING_VSYNC || gPacing == PACING_ADAPTIVE ) && !( info.flags & SDL_RENDERER_PRESENTVSYNC ) )
     {
-       file.close();
+        printf( "Warning: Vsync not granted by the %s renderer, limiting frames instead!\n", info.name );
+        gPacing = PACING_LIMITER;
     }
 
-    //magic #; score of 1 should not happen while in game
-    if (highScore != 1)
+    //Without --frame-cap the limiter runs at the refresh rate of the display the window is on
+    if( gPacing == PACING_LIMITER && gFrameCap == 0 )
     {
-        //Evaluate and update as necessary
-        file.open("hs.hs", fstream::out | fstream::trunc);
-        if (file.good())
+        SDL_DisplayMode mode;
+        int display = SDL_GetWindowDisplayIndex( gWindow );
+        if( display >= 0 && SDL_GetCurrentDisplayMode( display, &mode ) == 0 && mode.refresh_rate > 0 )
         {
-            sprintf(s, "%d", highScore);
-            file<<s;
+            gFrameCap = std::min( mode.refresh_rate, MAX_FRAME_CAP );
         }
-
-        if (file.is_open())
+        else
         {
-           file.close();
+            gFrameCap = DEFAULT_FRAME_CAP;
         }
     }
 }
 
-void calculateScore()
+bool parseOptions( int argc, char* args[] )
 {
-    SDL_Color textColor = { 72, 45, 30 };
-    char c[30];
+	bool pacingSet = false;
 
-    if ((SDL_GetTicks() - startTime) % 100 == 0 && SDL_GetTicks() - startTime >= 3000)
-    {
-        currentScore += 5;
-    }
+	for( int i = 1; i < argc; ++i )
+	{
+		if( strcmp( args[ i ], "--tick-rate" ) == 0 && i + 1 < argc )
+		{
+			gTickRate = atoi( args[ ++i ] );
+			if( gTickRate < MIN_TICK_RATE || gTickRate > MAX_TICK_RATE )
+			{
+				printf( "Tick rate must be between %d and %d!\n", MIN_TICK_RATE, MAX_TICK_RATE );
+				return false;
+			}
+		}
+		else if( strcmp( args[ i ], "--max-catch-up" ) == 0 && i + 1 < argc )
+		{
+			gMaxCatchUpMs = atoi( args[ ++i ] );
+			if( gMaxCatchUpMs <= 0 )
+			{
+				printf( "Catch-up budget must be positive!\n" );
+				return false;
+			}
+		}
+		else if( strcmp( args[ i ], "--obstacles" ) == 0 && i + 1 < argc )
+		{
+			gObstacleSettings.capacity = atoi( args[ ++i ] );
+			if( gObstacleSettings.capacity < 1 || gObstacleSettings.capacity > MAX_NUM_OF_OBSTACLES )
+			{
+				printf( "Obstacle count must be between 1 and %d!\n", MAX_NUM_OF_OBSTACLES );
+				return false;
+			}
+		}
+		else if( strcmp( args[ i ], "--spacing" ) == 0 && i + 1 < argc )
+		{
+			gObstacleSettings.spacing = atoi( args[ ++i ] );
+			if( gObstacleSettings.spacing < 0 || gObstacleSettings.spacing > MAX_OBSTACLE_SPACING )
+			{
+				printf( "Obstacle spacing must be between 0 and %d!\n", MAX_OBSTACLE_SPACING );
+				return false;
+			}
+		}
+		else if( strcmp( args[ i ], "--density" ) == 0 && i + 1 < argc )
+		{
+			gObstacleSettings.density = atoi( args[ ++i ] );
+			if( gObstacleSettings.density < 0 || gObstacleSettings.density > 100 )
+			{
+				printf( "Obstacle density must be between 0 and 100!\n" );
+				return false;
+			}
+		}
+		else if( strcmp( args[ i ], "--collide" ) == 0 && i + 1 < argc )
+		{
+			if( !ColliderStore::selectKernel( args[ ++i ] ) )
+			{
+				printf( "Collision kernel %s is unknown or not supported by this CPU!\n", args[ i ] );
+				return false;
+			}
+			gCollideKernelSet = true;
+		}
+		else if( strcmp( args[ i ], "--hitboxes" ) == 0 && i + 1 < argc )
+		{
+			gCollisionSettings.hitboxes = atoi( args[ ++i ] );
+			if( gCollisionSettings.hitboxes < 1 || gCollisionSettings.hitboxes > MAX_NUM_OF_HITBOXES )
+			{
+				printf( "Hitbox count must be between 1 and %d!\n", MAX_NUM_OF_HITBOXES );
+				return false;
+			}
+		}
+		else if( strcmp( args[ i ], "--box-collision" ) == 0 )
+		{
+			gCollisionSettings.boxesOnly = true;
+		}
+		else if( strcmp( args[ i ], "--hitbox-report" ) == 0 )
+		{
+			gReportHitboxes = true;
+		}
+		else if( strcmp( args[ i ], "--collide-selftest" ) == 0 )
+		{
+			gTestCollide = true;
+		}
+		else if( strcmp( args[ i ], "--pacing" ) == 0 && i + 1 < argc )
+		{
+			++i;
+			pacingSet = false;
+			for( int mode = 0; mode < NUM_OF_PACING_MODES; ++mode )
+			{
+				if( strcmp( args[ i ], PACING_NAMES[ mode ] ) == 0 )
+				{
+					gPacing = (PacingMode)mode;
+					pacingSet = true;
+				}
+			}
+			if( !pacingSet )
+			{
+				printf( "Pacing mode %s is unknown, use vsync, adaptive, uncapped or limiter!\n", args[ i ] );
+				return false;
+			}
+		}
+		else if( strcmp( args[ i ], "--frame-cap" ) == 0 && i + 1 < argc )
+		{
+			gFrameCap = atoi( args[ ++i ] );
+			if( gFrameCap < 1 || gFrameCap > MAX_FRAME_CAP )
+			{
+				printf( "Frame cap must be between 1 and %d!\n", MAX_FRAME_CAP );
+				return false;
+			}
+		}
+		else if( strcmp( args[ i ], "--pacing-report" ) == 0 )
+		{
+			gReportPacing = true;
+		}
+		else if( strcmp( args[ i ], "--latency" ) == 0 )
+		{
+			gMeasureLatency = true;
+		}
+		else if( strcmp( args[ i ], "--profile" ) == 0 )
+		{
+			gShowProfiler = true;
+		}
+		else if( strcmp( args[ i ], "--render-stats" ) == 0 )
+		{
+			gLogRenderStats = true;
+		}
+		else if( strcmp( args[ i ], "--trace" ) == 0 && i + 1 < argc )
+		{
+			gTracePath = args[ ++i ];
+		}
+		else if( strcmp( args[ i ], "--pack" ) == 0 )
+		{
+			gWritePack = true;
+		}
+		else if( strcmp( args[ i ], "--headless" ) == 0 )
+		{
+			gHeadless = true;
+		}
+		else if( strcmp( args[ i ], "--ticks" ) == 0 && i + 1 < argc )
+		{
+			gBenchTicks = strtoul( args[ ++i ], NULL, 10 );
+			if( gBenchTicks == 0 )
+			{
+				printf( "Tick count must be positive!\n" );
+				return false;
+			}
+		}
+		else if( strcmp( args[ i ], "--threads" ) == 0 && i + 1 < argc )
+		{
+			gBenchThreads = atoi( args[ ++i ] );
+		}
+		else if( strcmp( args[ i ], "--seed" ) == 0 && i + 1 < argc )
+		{
+			gBenchSeed = strtoul( args[ ++i ], NULL, 10 );
+		}
+		else if( strcmp( args[ i ], "--script" ) == 0 && i + 1 < argc )
+		{
+			if( !loadInputScript( args[ ++i ], gInputScript ) )
+			{
+				return false;
+			}
+		}
+		else if( strcmp( args[ i ], "--record" ) == 0 && i + 1 < argc )
+		{
+			gRecordPath = args[ ++i ];
+		}
+		else if( strcmp( args[ i ], "--replay" ) == 0 && i + 1 < argc )
+		{
+			if( !loadRecording( args[ ++i ], gReplay ) )
+			{
+				return false;
+			}
+			gReplaying = true;
+		}
+		else
+		{
+			printf( "Unknown option %s!\n", args[ i ] );
+			return false;
+		}
+	}
+
+	//A frame cap alone asks for the limiter, which is the only mode it applies to
+	if( gFrameCap > 0 && !pacingSet )
+	{
+		gPacing = PACING_LIMITER;
+	}
+	else if( gFrameCap > 0 && gPacing != PACING_LIMITER )
+	{
+		printf( "Frame cap only applies to the limiter pacing!\n" );
+		return false;
+	}
 
-    sprintf(c, "Score: %d", currentScore);
+	//Replays run at the rate they were recorded at
+	if( gReplaying && gReplay.tickRate != gTickRate )
+	{
+		if( gReplay.tickRate < MIN_TICK_RATE || gReplay.tickRate > MAX_TICK_RATE )
+		{
+			printf( "Recording has an invalid tick rate!\n" );
+			return false;
+		}
+		gTickRate = gReplay.tickRate;
+	}
 
-    //Render text
-    if( !gScoreTexture.loadFromRenderedText( c, textColor ) )
-    {
-        printf( "Unable to render time texture!\n" );
-    }
+	//And with the obstacles they were recorded with
+	if( gReplaying )
+	{
+		if( gReplay.obstacles.capacity < 1 || gReplay.obstacles.capacity > MAX_NUM_OF_OBSTACLES ||
+			gReplay.obstacles.spacing < 0 || gReplay.obstacles.spacing > MAX_OBSTACLE_SPACING ||
+			gReplay.obstacles.density < 0 || gReplay.obstacles.density > 100 )
+		{
+			printf( "Recording has invalid obstacle settings!\n" );
+			return false;
+		}
+		gObstacleSettings = gReplay.obstacles;
+	}
+
+	//And collided the way they were recorded
+	if( gReplaying )
+	{
+		if( gReplay.collision.hitboxes < 1 || gReplay.collision.hitboxes > MAX_NUM_OF_HITBOXES )
+		{
+			printf( "Recording has an invalid hitbox count!\n" );
+			return false;
+		}
+		gCollisionSettings = gReplay.collision;
+	}
+
+	return true;
 }
 
 int main( int argc, char* args[] )
 {
+	//Read command line options
+	if( !parseOptions( argc, args ) )
+	{
+		printf( "Usage: %s [--tick-rate <hz>] [--max-catch-up <ms>] [--obstacles <n>] [--spacing <px>] [--density <percent>] [--collide <kernel>] [--hitboxes <n>] [--box-collision] [--pacing <mode>] [--frame-cap <fps>] [--pacing-report] [--latency] [--profile] [--trace <file>] [--render-stats]\n", args[ 0 ] );
+		printf( "       %s [--record <file> | --replay <file>]\n", args[ 0 ] );
+		printf( "       %s --headless [--ticks <n>] [--threads <n>] [--seed <n>] [--script <file> | --replay <file>]\n", args[ 0 ] );
+		printf( "       %s --pack\n", args[ 0 ] );
+		printf( "       %s --hitbox-report [--hitboxes <n>]\n", args[ 0 ] );
+		printf( "       %s --collide-selftest\n", args[ 0 ] );
+		return 1;
+	}
+
+	//Pick the widest collision kernel the CPU supports
+	if( !gCollideKernelSet )
+	{
+		ColliderStore::selectKernel( "auto" );
+	}
+
+	//Build the asset archive offline
+	if( gWritePack )
+	{
+		return writeAssetPack();
+	}
+
+	//Show what each hitbox budget costs in precision
+	if( gReportHitboxes )
+	{
+		return reportHitboxes();
+	}
+
+	//Make sure the vector kernels collide exactly like the scalar one
+	if( gTestCollide )
+	{
+		return testCollideKernels();
+	}
+
+	//Capture from startup so init and loading stalls show up
+	if( !gTracePath.empty() && !gTrace.start() )
+	{
+		printf( "Unable to allocate trace buffer!\n" );
+		return 1;
+	}
+
+	//Benchmark the simulation alone, no window needed, only the collision masks
+	if( gHeadless )
+	{
+		int result = loadCollisionMasks() ? runHeadless() : 1;
+		if( gTrace.isActive() )
+		{
+			gTrace.write( gTracePath );
+		}
+		gAssetPack.close();
+		IMG_Quit();
+		SDL_Quit();
+		return result;
+	}
+
 	//Start up SDL and create window
-	if( !init() )
+	bool replayFailed = false;
+	gTrace.begin( "init" );
+	bool initialized = init();
+	gTrace.end( "init" );
+
+	if( !initialized )
 	{
 		printf( "Failed to initialize!\n" );
 	}
@@ -1322,17 +6911,21 @@ int main( int argc, char* args[] )
 		{
 			printf( "Failed to load media!\n" );
 		}
-		else
+		//Replays play their one game and report frame times, failing the run on a regression
+		else if( !runScenes( gReplaying ? SCENE_LOADING : SCENE_MENU ) )
 		{
-			startTime = 0;
-			endGame = false;
-
-			showMenu();
+			replayFailed = true;
 		}
 	}
 
+	//Write the session trace before tearing down
+	if( gTrace.isActive() )
+	{
+		gTrace.write( gTracePath );
+	}
+
 	//Free resources and close SDL
 	close();
 
-	return 0;
+	return replayFailed ? 1 : 0;
 }